@@ -1686,7 +1686,7 @@ IPState EQMod::GuideNorth(float ms) {
   try {
     if (ms > 0.0) {
       mount->StartDETracking(GetDETrackRate() + rateshift);
-      GuideTimerNS = IEAddTimer((int)(ms), (IE_TCF *)timedguideNSCallback, this);
+      GuideTimerNS = IEAddTimerUs((long)(ms*1000), (IE_TCF *)timedguideNSCallback, this);
     }
   } catch(EQModError e) {
     e.DefaultHandleException(this);
@@ -1704,7 +1704,7 @@ IPState EQMod::GuideSouth(float ms) {
   try {
     if (ms > 0.0) {
       mount->StartDETracking(GetDETrackRate() - rateshift);
-      GuideTimerNS = IEAddTimer((int)(ms), (IE_TCF *)timedguideNSCallback, this);
+      GuideTimerNS = IEAddTimerUs((long)(ms*1000), (IE_TCF *)timedguideNSCallback, this);
     }
   } catch(EQModError e) {
     e.DefaultHandleException(this);
@@ -1722,7 +1722,7 @@ IPState EQMod::GuideEast(float ms) {
   try {
     if (ms > 0.0) {
       mount->StartRATracking(GetRATrackRate() - rateshift);
-      GuideTimerWE = IEAddTimer((int)(ms), (IE_TCF *)timedguideWECallback, this);
+      GuideTimerWE = IEAddTimerUs((long)(ms*1000), (IE_TCF *)timedguideWECallback, this);
     }
   } catch(EQModError e) {
     e.DefaultHandleException(this);
@@ -1740,7 +1740,7 @@ IPState EQMod::GuideWest(float ms) {
   try {
     if (ms > 0.0) {
       mount->StartRATracking(GetRATrackRate() + rateshift);
-      GuideTimerWE = IEAddTimer((int)(ms), (IE_TCF *)timedguideWECallback, this);
+      GuideTimerWE = IEAddTimerUs((long)(ms*1000), (IE_TCF *)timedguideWECallback, this);
     }
   } catch(EQModError e) {
     e.DefaultHandleException(this);
@@ -587,7 +587,7 @@ IPState SXCCD::GuideWest(float time) {
     GuideStatus &= SX_CLEAR_WE;
     sxSetSTAR2000(handle, GuideStatus);
   } else
-    WEGuiderTimerID = IEAddTimer(time, WEGuiderTimerCallback, this);
+    WEGuiderTimerID = IEAddTimerUs((long)(time * 1000), WEGuiderTimerCallback, this);
   return IPS_OK;
 }
 
@@ -607,7 +607,7 @@ IPState SXCCD::GuideEast(float time) {
     GuideStatus &= SX_CLEAR_WE;
     sxSetSTAR2000(handle, GuideStatus);
   } else
-    WEGuiderTimerID = IEAddTimer(time, WEGuiderTimerCallback, this);
+    WEGuiderTimerID = IEAddTimerUs((long)(time * 1000), WEGuiderTimerCallback, this);
   return IPS_OK;
 }
 
@@ -634,7 +634,7 @@ IPState SXCCD::GuideNorth(float time) {
     GuideStatus &= SX_CLEAR_NS;
     sxSetSTAR2000(handle, GuideStatus);
   } else
-    NSGuiderTimerID = IEAddTimer(time, NSGuiderTimerCallback, this);
+    NSGuiderTimerID = IEAddTimerUs((long)(time * 1000), NSGuiderTimerCallback, this);
   return IPS_OK;
 }
 
@@ -654,7 +654,7 @@ IPState SXCCD::GuideSouth(float time) {
     GuideStatus &= SX_CLEAR_NS;
     sxSetSTAR2000(handle, GuideStatus);
   } else
-    NSGuiderTimerID = IEAddTimer(time, NSGuiderTimerCallback, this);
+    NSGuiderTimerID = IEAddTimerUs((long)(time * 1000), NSGuiderTimerCallback, this);
   return IPS_OK;
 }
 
@@ -21,6 +21,8 @@
 #ifndef BASE64_H
 #define BASE64_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,19 +36,54 @@ extern "C" {
     \param out output buffer in base64. The buffer size must be at least (4 * inlen / 3 + 4) bytes long.
     \param in input binary buffer
     \param inlen number of bytes to convert
-    \return 0 on success, -1 on failure.
+    \return length of base64 string in out, sans trailing NUL.
  */
 extern int to64frombits(unsigned char *out, const unsigned char *in,
     int inlen);
+
+/** \brief Convert bytes array to base64, checking the size of out.
+    \param out output buffer in base64.
+    \param in input binary buffer
+    \param inlen number of bytes to convert
+    \param outlen size of out, must be at least (4 * ((inlen + 2) / 3) + 1) bytes.
+    \return length of base64 string in out, sans trailing NUL, or -1 if out is too small.
+ */
+extern int to64frombits_s(unsigned char *out, const unsigned char *in,
+    int inlen, size_t outlen);
     
 /** \brief Convert base64 to bytes array.
     \param out output buffer in bytes. The buffer size must be at least (3 * size_of_in_buffer / 4) bytes long.
     \param in input base64 buffer
-    \return 0 on success, -1 on failure.
+    \return number of bytes in out, or <0 on error.
  */
 
 extern int from64tobits(char *out, const char *in);
 
+/** \brief Convert inlen chars of base64 to bytes array.
+    \param out output buffer in bytes. The buffer size must be at least (3 * inlen / 4) bytes long.
+    \param in input base64 buffer, may contain whitespace such as line breaks and need not be NUL-terminated.
+    \param inlen number of chars of in to convert
+    \return number of bytes in out, or <0 on error.
+ */
+extern int from64tobits_fast(char *out, const char *in, int inlen);
+
+/** \brief State of a base64 stream decoded piece by piece with from64tobits_more(). Start each stream with all zeros. */
+typedef struct {
+    char d[4];		/**< digits of a quartet cut off at the end of a piece */
+    int n;		/**< number of digits in d */
+    int pad;		/**< set once = padding has ended the data */
+} Base64Carry;
+
+/** \brief Convert the next piece of a base64 stream to bytes array.
+    Pieces may be cut anywhere, even within a quartet, so base64 can be decoded as it arrives. The stream is complete when the carry holds no digits.
+    \param out output buffer in bytes. The buffer size must be at least (3 * inlen / 4 + 3) bytes long.
+    \param in the next piece of base64, may contain whitespace such as line breaks.
+    \param inlen number of chars of in to convert
+    \param cp state carried from one piece to the next.
+    \return number of bytes in out, or <0 on error.
+ */
+extern int from64tobits_more(char *out, const char *in, int inlen, Base64Carry *cp);
+
 /*@}*/
 
 #ifdef __cplusplus
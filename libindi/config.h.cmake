@@ -13,6 +13,12 @@
 /* Define if you have libnova.h */
 #cmakedefine   HAVE_NOVA_H 1
 
+/* Define if you have sys/epoll.h */
+#cmakedefine   HAVE_SYS_EPOLL_H 1
+
+/* Use epoll in indiserver and the driver event loop */
+#cmakedefine   WITH_EPOLL
+
 /* Set INDI Library version */
 #cmakedefine CMAKE_INDI_VERSION_STRING "@CMAKE_INDI_VERSION_STRING@"
 
@@ -1178,7 +1178,7 @@ IPState CelestronGPS::GuideNorth(float ms)
       SlewRateS[SLEW_GUIDE].s = ISS_ON;
       IDSetSwitch(&SlewRateSP, NULL);
       guide_direction = CELESTRON_N;
-      GuideNSTID = IEAddTimer (ms, guideTimeoutHelperN, this);
+      GuideNSTID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelperN, this);
       return IPS_BUSY;
 }
 
@@ -1228,7 +1228,7 @@ IPState CelestronGPS::GuideSouth(float ms)
       SlewRateS[SLEW_GUIDE].s = ISS_ON;
       IDSetSwitch(&SlewRateSP, NULL);
       guide_direction = CELESTRON_S;
-      GuideNSTID = IEAddTimer (ms, guideTimeoutHelperS, this);
+      GuideNSTID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelperS, this);
       return IPS_BUSY;
 }
 
@@ -1278,7 +1278,7 @@ IPState CelestronGPS::GuideEast(float ms)
       SlewRateS[SLEW_GUIDE].s = ISS_ON;
       IDSetSwitch(&SlewRateSP, NULL);
       guide_direction = CELESTRON_E;
-      GuideWETID = IEAddTimer (ms, guideTimeoutHelperE, this);
+      GuideWETID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelperE, this);
       return IPS_BUSY;
 }
 
@@ -1330,7 +1330,7 @@ IPState CelestronGPS::GuideWest(float ms)
       SlewRateS[SLEW_GUIDE].s = ISS_ON;
       IDSetSwitch(&SlewRateSP, NULL);
       guide_direction = CELESTRON_W;
-      GuideWETID = IEAddTimer (ms, guideTimeoutHelperW, this);
+      GuideWETID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelperW, this);
       return IPS_BUSY;
   
 }
@@ -1448,7 +1448,7 @@ IPState LX200Generic::GuideNorth(float ms)
       SlewRateS[SLEW_GUIDE].s = ISS_ON;
       IDSetSwitch(&SlewRateSP, NULL);
       guide_direction = LX200_NORTH;
-      GuideNSTID = IEAddTimer (ms, guideTimeoutHelper, this);
+      GuideNSTID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelper, this);
       return IPS_BUSY;
 }
 
@@ -1500,7 +1500,7 @@ IPState LX200Generic::GuideSouth(float ms)
     SlewRateS[SLEW_GUIDE].s = ISS_ON;
     IDSetSwitch(&SlewRateSP, NULL);
     guide_direction = LX200_SOUTH;
-    GuideNSTID = IEAddTimer (ms, guideTimeoutHelper, this);
+    GuideNSTID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelper, this);
     return IPS_BUSY;
 
 }
@@ -1554,7 +1554,7 @@ IPState LX200Generic::GuideEast(float ms)
     SlewRateS[SLEW_GUIDE].s = ISS_ON;
     IDSetSwitch(&SlewRateSP, NULL);
     guide_direction = LX200_EAST;
-    GuideWETID = IEAddTimer (ms, guideTimeoutHelper, this);
+    GuideWETID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelper, this);
     return IPS_BUSY;
 
 }
@@ -1607,7 +1607,7 @@ IPState LX200Generic::GuideWest(float ms)
     SlewRateS[SLEW_GUIDE].s = ISS_ON;
     IDSetSwitch(&SlewRateSP, NULL);
     guide_direction = LX200_WEST;
-    GuideWETID = IEAddTimer (ms, guideTimeoutHelper, this);
+    GuideWETID = IEAddTimerUs ((long)(ms*1000), guideTimeoutHelper, this);
     return IPS_BUSY;
 
 }
@@ -32,6 +32,13 @@
  #define MAIN_TEST for a stand-alone test program.
  */
 
+#include "config.h"
+
+/* wait with epoll unless built for the portable select() loop */
+#if defined(WITH_EPOLL) && defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -40,6 +47,11 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <unistd.h>
+#ifdef USE_EPOLL
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include "eventloop.h"
 
@@ -58,21 +70,47 @@ static int ncback;			/* n entries in cback[] */
 static int ncbinuse;			/* n entries in cback[] marked in_use */
 static int lastcb;			/* cback index of last cb called */
 
+#ifdef USE_EPOLL
+/* all callback fds are watched by one epoll instance, made with the first
+ * callback. if epoll can not watch one, eg a plain file, we go back to
+ * select() for good.
+ */
+static int epfd = -1;			/* epoll fd, -1 until made, -2 if not */
+#define	MAXEPEVENTS	64		/* most events taken per epoll_wait() */
+
+/* epoll_wait() only waits whole ms, so a timerfd in the epoll set wakes us
+ * for the soonest timer to the us instead.
+ */
+static int tfd = -1;			/* timerfd, -1 if none */
+static double tfdgo;			/* tgo tfd is armed for, 0 if disarmed */
+#endif
+
 /* info about one registered timer function.
- * the entries are kept sorted by decreasing time from epoch, ie,
- *   the next entry to fire is at the end of the array.
+ * the entries form a binary heap on trigger time, ties broken by id, ie,
+ *   the next entry to fire is timef[0] and each entry fires no sooner than
+ *   its parent. timeidx[] finds the heap position of each id so rmTimer()
+ *   need not search.
  */
 typedef struct {
-    double tgo;				/* trigger time, ms from epoch */
+    double tgo;				/* trigger time, us on nowUS() clock */
     void *ud;				/* user's data handle */
     TCF *fp;				/* timer function */
     int tid;				/* unique id for this timer */
 } TF;
-static TF *timef;			/* malloced list of timer functions */
-static int ntimef;			/* n entries in ntimef[] */
+static TF *timef;			/* malloced heap of timer functions */
+static int ntimef;			/* n entries in timef[] */
+static int mtimef;			/* n entries malloced for timef[] */
 static int tid;				/* source of unique timer ids */
-#define	EPOCHDT(tp) 			/* ms from epoch to timeval *tp */  \
-	(((tp)->tv_usec)/1000.0 + ((tp)->tv_sec)*1000.0)
+
+/* open addressed hash from timer id to its index in timef[].
+ * ids are sequential so the id itself is a good hash.
+ */
+typedef struct {
+    int tid;				/* timer id, 0 if slot is free */
+    int pos;				/* index in timef[] */
+} TI;
+static TI *timeidx;			/* malloced hash table */
+static int ntimeidx;			/* n slots, a power of 2 */
 
 /* info about one registered work procedure.
  * the malloced array wproc is never shrunk, entries are reused. new id's are
@@ -93,6 +131,19 @@ static void callCallback(fd_set *rfdp);
 static void checkTimer();
 static void oneLoop(void);
 static void deferTO (void *p);
+static double nowUS (void);
+static int newTimer (double us, TCF *fp, void *ud);
+static TI *findTimerIdx (int id);
+static void placeTimer (int i);
+static void upTimer (int i);
+static void downTimer (int i);
+static void popTimer (int i);
+#ifdef USE_EPOLL
+static void watchFD (int fd);
+static void unwatchFD (int fd);
+static int waitEpoll (fd_set *rfdp, int ms);
+static int armTimerFD (void);
+#endif
 
 /* inf loop to dispatch callbacks, work procs and timers as necessary.
  * never returns.
@@ -176,6 +227,10 @@ addCallback (int fd, CBF *fp, void *ud)
 	cp->fd = fd;
 	ncbinuse++;
 
+#ifdef USE_EPOLL
+	watchFD (fd);
+#endif
+
 	/* id is index into array */
 	return (cp - cback);
 }
@@ -198,40 +253,84 @@ rmCallback (int cid)
 	/* mark for reuse */
 	cp->in_use = 0;
 	ncbinuse--;
+
+#ifdef USE_EPOLL
+	unwatchFD (cp->fd);
+#endif
 }
 
 /* register a new timer function, fp, to be called with ud as arg after ms
- * milliseconds. add to list in order of decreasing time from epoch, ie,
- * last entry runs soonest. return id for use with rmTimer().
+ * milliseconds. return id for use with rmTimer().
  */
 int
 addTimer (int ms, TCF *fp, void *ud)
 {
-	struct timeval t;
+	return (newTimer (ms*1000.0, fp, ud));
+}
+
+/* register a new timer function, fp, to be called with ud as arg after us
+ * microseconds. return id for use with rmTimer().
+ */
+int
+addTimerUs (long us, TCF *fp, void *ud)
+{
+	return (newTimer ((double)us, fp, ud));
+}
+
+/* return microseconds on a clock that only moves forward at a steady rate,
+ * so timers are not moved by changes to the time of day.
+ */
+static double
+nowUS()
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+	    return (ts.tv_sec*1000000.0 + ts.tv_nsec/1000.0);
+#endif
+	{
+	    struct timeval tv;
+	    gettimeofday (&tv, NULL);
+	    return (tv.tv_sec*1000000.0 + tv.tv_usec);
+	}
+}
+
+/* add a timer to fire us microseconds from now to the heap, ie, timef[0]
+ * runs soonest. return its new unique id.
+ */
+static int
+newTimer (double us, TCF *fp, void *ud)
+{
+	double now = nowUS();
 	TF *tp;
 
-	/* get time now */
-	gettimeofday (&t, NULL);
+	/* grow heap and index by doubling, keeping the index at most half full */
+	if (ntimef == mtimef) {
+	    mtimef = mtimef ? 2*mtimef : 16;
+	    timef = (TF *) realloc (timef, mtimef*sizeof(TF));
+	}
+	if (2*(ntimef+1) > ntimeidx) {
+	    int i;
+	    free (timeidx);
+	    ntimeidx = ntimeidx ? 2*ntimeidx : 32;
+	    timeidx = (TI *) calloc (ntimeidx, sizeof(TI));
+	    for (i = 0; i < ntimef; i++)
+		placeTimer (i);
+	}
 
-	/* add one entry */
-	timef = timef ? (TF *) realloc (timef, (ntimef+1)*sizeof(TF))
-		      : (TF *) malloc (sizeof(TF));
+	/* init new entry, with new unique id, at the bottom */
 	tp = &timef[ntimef++];
-
-	/* init new entry */
 	tp->ud = ud;
 	tp->fp = fp;
-	tp->tgo = EPOCHDT(&t) + ms;
+	tp->tgo = now + us;
+	tp->tid = ++tid;
 
-	/* insert maintaining sort */
-	for ( ; tp > timef && tp[0].tgo > tp[-1].tgo; tp--) {
-	    TF tmptf = tp[-1];
-	    tp[-1] = tp[0];
-	    tp[0] = tmptf;
-	}
+	/* move up to its place */
+	placeTimer (ntimef-1);
+	upTimer (ntimef-1);
 
-	/* store and return new unique id */
-	return (tp->tid = ++tid);
+	return (tid);
 }
 
 /* remove the timer with the given id, as returned from addTimer().
@@ -240,21 +339,10 @@ addTimer (int ms, TCF *fp, void *ud)
 void
 rmTimer (int timer_id)
 {
-	TF *tp;
+	TI *ip = findTimerIdx (timer_id);
 
-	/* find it */
-	for (tp = timef; tp < &timef[ntimef]; tp++)
-	    if (tp->tid == timer_id)
-		break;
-	if (tp == &timef[ntimef])
-	    return;
-
-	/* bubble it out */
-	for (++tp; tp < &timef[ntimef]; tp++)
-	    tp[-1] = tp[0];
-
-	/* shrink list */
-	timef = (TF *) realloc (timef, (--ntimef)*sizeof(TF));
+	if (ip)
+	    popTimer (ip->pos);
 }
 
 /* add a new work procedure, fp, to be called with ud when nothing else to do.
@@ -326,49 +414,279 @@ runWorkProc ()
 	(*wp->fp) (wp->ud);
 }
 
-/* run next callback whose fd is listed as ready to go in rfdp */
+/* run next callback whose fd is listed as ready to go in rfdp.
+ * a timer may have removed them all since the fds were checked.
+ */
 static void
 callCallback(fd_set *rfdp)
 {
 	CB *cp;
+	int n;
 
 	/* skip if list is empty */
 	if (!ncbinuse)
 	    return;
 
 	/* find next */
-	do {
+	for (n = 0; n < ncback; n++) {
 	    lastcb = (lastcb+1) % ncback;
 	    cp = &cback[lastcb];
-	} while (!cp->in_use || !FD_ISSET (cp->fd, rfdp));
-
-	/* run */
-	(*cp->fp) (cp->fd, cp->ud);
+	    if (cp->in_use && FD_ISSET (cp->fd, rfdp)) {
+		/* run */
+		(*cp->fp) (cp->fd, cp->ud);
+		return;
+	    }
+	}
 }
 
-/* run the next timer callback whose time has come, if any. all we have to do
- * is is check the last entry in timef[] because it is sorted in decreasing
- * order of time from epoch to run, ie, last entry runs soonest.
+/* run each timer callback whose time has come, soonest first. all we have to
+ * do is check timef[0] because it always runs soonest. timers added by these
+ * callbacks wait for the next loop even if already due, so a timer that
+ * rearms itself with 0 ms can not starve the fds.
  */
 static void
 checkTimer()
 {
-	struct timeval now;
 	double tgonow;
-	TF *tp;
+	int lasttid = tid;
 
 	/* skip if list is empty */
 	if (!ntimef)
 	    return;
 
-	gettimeofday (&now, NULL);
-	tgonow = EPOCHDT (&now);
-	tp = &timef[ntimef-1];
-	if (tp->tgo <= tgonow) {
-	    ntimef--;			/* pop then call */
-	    (*tp->fp) (tp->ud);
+	tgonow = nowUS();
+	while (ntimef > 0 && timef[0].tgo <= tgonow && timef[0].tid <= lasttid) {
+	    TF tf = timef[0];		/* pop then call */
+	    popTimer (0);
+	    (*tf.fp) (tf.ud);
+	}
+}
+
+/* return the timeidx[] slot of the given timer id, else NULL */
+static TI *
+findTimerIdx (int id)
+{
+	int i;
+
+	if (!ntimeidx)
+	    return (NULL);
+
+	for (i = id & (ntimeidx-1); timeidx[i].tid; i = (i+1) & (ntimeidx-1))
+	    if (timeidx[i].tid == id)
+		return (&timeidx[i]);
+	return (NULL);
+}
+
+/* record in timeidx[] that timef[i] is at index i */
+static void
+placeTimer (int i)
+{
+	int id = timef[i].tid;
+	TI *ip = findTimerIdx (id);
+
+	if (!ip) {
+	    int j;
+	    for (j = id & (ntimeidx-1); timeidx[j].tid; j = (j+1) & (ntimeidx-1))
+		continue;
+	    ip = &timeidx[j];
+	    ip->tid = id;
+	}
+	ip->pos = i;
+}
+
+/* 1 if timef[i] runs before timef[j], ties in order added */
+#define	TIMERBEFORE(i,j)	(timef[i].tgo < timef[j].tgo || 		\
+	    (timef[i].tgo == timef[j].tgo && timef[i].tid < timef[j].tid))
+
+/* swap timef[i] and timef[j], keeping timeidx[] current */
+static void
+swapTimer (int i, int j)
+{
+	TF tmptf = timef[i];
+	timef[i] = timef[j];
+	timef[j] = tmptf;
+	placeTimer (i);
+	placeTimer (j);
+}
+
+/* move timef[i] toward the root until it runs no sooner than its parent */
+static void
+upTimer (int i)
+{
+	while (i > 0 && TIMERBEFORE (i, (i-1)/2)) {
+	    swapTimer (i, (i-1)/2);
+	    i = (i-1)/2;
+	}
+}
+
+/* move timef[i] toward the leaves until it runs no later than its children */
+static void
+downTimer (int i)
+{
+	while (1) {
+	    int c = 2*i + 1;
+	    if (c >= ntimef)
+		break;
+	    if (c+1 < ntimef && TIMERBEFORE (c+1, c))
+		c++;
+	    if (!TIMERBEFORE (c, i))
+		break;
+	    swapTimer (i, c);
+	    i = c;
+	}
+}
+
+/* remove timef[i] from the heap and its id from timeidx[] */
+static void
+popTimer (int i)
+{
+	TI *ip = findTimerIdx (timef[i].tid);
+	int mask = ntimeidx-1;
+	int j, k;
+
+	/* free its slot, shifting back later entries of the same probe run */
+	for (j = ip - timeidx; ; ) {
+	    timeidx[j].tid = 0;
+	    for (k = (j+1) & mask; timeidx[k].tid; k = (k+1) & mask) {
+		int h = timeidx[k].tid & mask;
+		/* may entry k move to the hole at j? only if h is not in (j,k] */
+		if (j <= k ? (h <= j || h > k) : (h <= j && h > k))
+		    break;
+	    }
+	    if (!timeidx[k].tid)
+		break;
+	    timeidx[j] = timeidx[k];
+	    j = k;
+	}
+
+	/* fill its place with the last entry and restore heap order */
+	if (i != --ntimef) {
+	    timef[i] = timef[ntimef];
+	    placeTimer (i);
+	    upTimer (i);
+	    downTimer (i);
+	}
+}
+
+#ifdef USE_EPOLL
+/* start watching fd for reading. the kernel, not cback[], says whether it
+ * already is: another callback may share the fd number but its registration
+ * is gone if that fd was closed and the number reused.
+ */
+static void
+watchFD (int fd)
+{
+	struct epoll_event ev;
+
+	if (epfd == -2)
+	    return;
+
+	if (epfd == -1) {
+	    epfd = epoll_create1 (EPOLL_CLOEXEC);
+	    if (epfd < 0) {
+		perror ("epoll_create1");
+		epfd = -2;
+		return;
+	    }
+
+#ifdef CLOCK_MONOTONIC
+	    /* nowUS() is CLOCK_MONOTONIC, so tfd can be armed with tgo */
+	    tfd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+	    if (tfd >= 0) {
+		memset (&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = tfd;
+		if (epoll_ctl (epfd, EPOLL_CTL_ADD, tfd, &ev) < 0) {
+		    close (tfd);
+		    tfd = -1;
+		}
+	    }
+#endif
+	}
+
+	memset (&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST) {
+	    /* eg a regular file, which select() always finds ready */
+	    close (epfd);
+	    epfd = -2;
+	    if (tfd >= 0) {
+		close (tfd);
+		tfd = -1;
+	    }
+	}
+}
+
+/* stop watching fd once no callback uses it. it may be closed already. */
+static void
+unwatchFD (int fd)
+{
+	CB *cp;
+
+	if (epfd < 0)
+	    return;
+
+	for (cp = cback; cp < &cback[ncback]; cp++)
+	    if (cp->in_use && cp->fd == fd)
+		return;
+
+	if (epoll_ctl (epfd, EPOLL_CTL_DEL, fd, NULL) < 0 && errno != EBADF
+							    && errno != ENOENT)
+	    perror ("epoll_ctl");
+}
+
+/* wait up to ms, or forever if < 0, for any callback fd to be readable.
+ * fill rfdp with those that are. return count as select() would.
+ */
+static int
+waitEpoll (fd_set *rfdp, int ms)
+{
+	struct epoll_event ev[MAXEPEVENTS];
+	int i, n;
+
+	FD_ZERO (rfdp);
+	n = epoll_wait (epfd, ev, MAXEPEVENTS, ms);
+	for (i = 0; i < n; i++) {
+	    if (ev[i].data.fd == tfd) {
+		/* expired, rearming will clear it */
+		tfdgo = -1;
+		n--;
+		ev[i--] = ev[n];
+	    } else if (ev[i].data.fd < FD_SETSIZE)
+		FD_SET (ev[i].data.fd, rfdp);
+	}
+	return (n);
+}
+
+/* arm tfd to expire when timef[0] is due, or disarm it if no timers.
+ * return 0 if ok, else -1 and the caller must time the wait itself.
+ */
+static int
+armTimerFD()
+{
+	double go = ntimef > 0 ? timef[0].tgo : 0;
+	struct itimerspec its;
+
+	if (go == tfdgo)
+	    return (0);
+
+	memset (&its, 0, sizeof(its));
+	if (go > 0) {
+	    its.it_value.tv_sec = (time_t)floor(go/1000000.0);
+	    its.it_value.tv_nsec = (long)((go - its.it_value.tv_sec*1000000.0)*1000.0);
+	    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+		its.it_value.tv_nsec = 1;	/* all 0 would disarm */
+	}
+	if (timerfd_settime (tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+	    perror ("timerfd_settime");
+	    tfdgo = -1;				/* unknown, try again next time */
+	    return (-1);
 	}
+	tfdgo = go;
+	return (0);
 }
+#endif
 
 /* check fd's from each active callback.
  * if any ready, call their callbacks else call each registered work procedure.
@@ -380,17 +698,7 @@ oneLoop()
 	fd_set rfd;
 	CB *cp;
 	int maxfd, ns;
-
-	/* build list of callback file descriptors to check */
-	FD_ZERO (&rfd);
-	maxfd = -1;
-	for (cp = cback; cp < &cback[ncback]; cp++) {
-	    if (cp->in_use) {
-		FD_SET (cp->fd, &rfd);
-		if (cp->fd > maxfd)
-		    maxfd = cp->fd;
-	    }
-	}
+	double late = 0;
 
 	/* determine timeout:
 	 * if there are work procs
@@ -404,24 +712,54 @@ oneLoop()
 	    tvp = &tv;
 	    tvp->tv_sec = tvp->tv_usec = 0;
 	} else if (ntimef > 0) {
-	    struct timeval now;
-	    double late;
-	    gettimeofday (&now, NULL);
-	    late = timef[ntimef-1].tgo - EPOCHDT (&now);	/* ms late */
+	    late = timef[0].tgo - nowUS();			/* us late */
 	    if (late < 0)
 		late = 0;
-	    late /= 1000.0;					/* secs late */
 	    tvp = &tv;
-	    tvp->tv_sec = (long)floor(late);
-	    tvp->tv_usec = (long)floor((late - tvp->tv_sec)*1000000.0);
+	    tvp->tv_sec = (long)floor(late/1000000.0);
+	    tvp->tv_usec = (long)ceil(late - tvp->tv_sec*1000000.0);
+	    if (tvp->tv_usec >= 1000000) {
+		tvp->tv_sec++;
+		tvp->tv_usec -= 1000000;
+	    }
 	} else
 	    tvp = NULL;
 
-	/* check file descriptors, timeout depending on pending work */
-	ns = select (maxfd+1, &rfd, NULL, NULL, tvp);
-	if (ns < 0) {
-	    perror ("select");
-            return;
+#ifdef USE_EPOLL
+	/* let tfd end the wait for the next timer, else round up to whole
+	 * ms so a timer is never early
+	 */
+	if (epfd >= 0) {
+	    int ms;
+	    if (tfd >= 0 && armTimerFD() == 0)
+		ms = nwpinuse > 0 ? 0 : -1;
+	    else
+		ms = tvp ? (int)ceil(late/1000.0) : -1;
+	    ns = waitEpoll (&rfd, ms);
+	    if (ns < 0) {
+		perror ("epoll_wait");
+		return;
+	    }
+	} else
+#endif
+	{
+	    /* build list of callback file descriptors to check */
+	    FD_ZERO (&rfd);
+	    maxfd = -1;
+	    for (cp = cback; cp < &cback[ncback]; cp++) {
+		if (cp->in_use) {
+		    FD_SET (cp->fd, &rfd);
+		    if (cp->fd > maxfd)
+			maxfd = cp->fd;
+		}
+	    }
+
+	    /* check file descriptors, timeout depending on pending work */
+	    ns = select (maxfd+1, &rfd, NULL, NULL, tvp);
+	    if (ns < 0) {
+		perror ("select");
+		return;
+	    }
 	}
 	
 	/* dispatch */
@@ -441,6 +779,108 @@ deferTO (void *p)
 	*(int*)p = 1;
 }
 
+#ifdef TIMER_BENCHMARK
+/* standalone benchmark of how late 10 ms timers fire, as used for guide
+ * pulses, with addTimer() and addTimerUs() while a thread keeps an fd busy.
+ * built as timerbench with -DINDI_BENCHMARKS=ON, make benchmarks runs it.
+ */
+
+#include <pthread.h>
+
+#define	NPULSES		200		/* pulses timed per kind */
+#define	PULSEUS		10000		/* pulse length, us */
+
+static double pulsego;			/* when the running pulse is due */
+static double pulselate[NPULSES];	/* us each pulse fired late */
+static int npulses;
+static int usepulse;			/* 1 to use addTimerUs() */
+static int pulsedone;
+
+static void
+pulseTO (void *ud)
+{
+	pulselate[npulses++] = nowUS() - pulsego;
+	if (npulses == NPULSES) {
+	    pulsedone = 1;
+	    return;
+	}
+	pulsego = nowUS() + PULSEUS;
+	if (usepulse)
+	    addTimerUs (PULSEUS, pulseTO, NULL);
+	else
+	    addTimer (PULSEUS/1000, pulseTO, NULL);
+}
+
+/* drain what loadThread() writes, as a driver reads its serial port */
+static void
+loadCB (int fd, void *ud)
+{
+	char buf[512];
+
+	if (read (fd, buf, sizeof(buf)) < 0)
+	    perror ("read");
+}
+
+static void *
+loadThread (void *ud)
+{
+	int fd = *(int *)ud;
+	char msg[64];
+
+	memset (msg, 'x', sizeof(msg));
+	while (write (fd, msg, sizeof(msg)) > 0)
+	    usleep (200);
+	return (NULL);
+}
+
+static int
+cmpLate (const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+	return (d < 0 ? -1 : d > 0);
+}
+
+int
+main (int ac, char *av[])
+{
+	pthread_t load;
+	int p[2];
+
+	if (pipe (p) < 0) {
+	    perror ("pipe");
+	    return (1);
+	}
+	addCallback (p[0], loadCB, NULL);
+	pthread_create (&load, NULL, loadThread, &p[1]);
+
+	for (usepulse = 0; usepulse < 2; usepulse++) {
+	    double sum = 0, sum2 = 0, mean;
+	    int i;
+
+	    npulses = pulsedone = 0;
+	    pulsego = nowUS() + PULSEUS;
+	    if (usepulse)
+		addTimerUs (PULSEUS, pulseTO, NULL);
+	    else
+		addTimer (PULSEUS/1000, pulseTO, NULL);
+	    deferLoop (0, &pulsedone);
+
+	    for (i = 0; i < NPULSES; i++) {
+		sum += pulselate[i];
+		sum2 += pulselate[i]*pulselate[i];
+	    }
+	    mean = sum/NPULSES;
+	    qsort (pulselate, NPULSES, sizeof(double), cmpLate);
+	    printf ("%-10s late us: mean %7.1f  jitter %7.1f  p99 %7.1f  max %7.1f\n",
+			usepulse ? "addTimerUs" : "addTimer", mean,
+			sqrt (sum2/NPULSES - mean*mean),
+			pulselate[NPULSES*99/100], pulselate[NPULSES-1]);
+	}
+
+	return (0);
+}
+#endif
+
 #if defined(MAIN_TEST)
 /* make a small stand-alone test program.
  */
@@ -90,6 +90,15 @@ extern void rmWorkProc (int wid);
 */
 extern int addTimer (int ms, TCF *fp, void *ud);
 
+/** Register a new timer function, \e fp, to be called with \e ud as argument after \e us. Like addTimer() but with microsecond resolution, for short precise delays such as guide pulses. All timers run on a monotonic clock, so changes to the time of day do not move them.
+*
+* \param us timer period in microseconds.
+* \param fp a pointer to the callback function.
+* \param ud a pointer to be passed to the callback function when called.
+* \return a unique id for use with rmTimer().
+*/
+extern int addTimerUs (long us, TCF *fp, void *ud);
+
 /** Remove the timer with the given \e id, as returned from addTimer().
 *
 * \param tid the timer callback ID returned from addTimer().
@@ -119,6 +119,15 @@ peekiFQ (FQ *q, int i)
 	return (q->nq > 0 ? q->q[q->head - q->nq + i] : NULL);
 }
 
+/* replace the ith element from head of the given FQ with e.
+ * i must be less than nFQ(q).
+ */
+void
+setiFQ (FQ *q, int i, void *e)
+{
+	q->q[q->head - q->nq + i] = e;
+}
+
 /* return the number of elements in the given FQ */
 int
 nFQ (FQ *q)
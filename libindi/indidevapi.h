@@ -361,6 +361,17 @@ extern void IERmCallback (int callbackid);
 */
 extern int  IEAddTimer (int millisecs, IE_TCF *fp, void *userpointer);
 
+/** \brief Register a new timer function, \e fp, to be called with \e userpointer as argument after \e microsecs.
+
+ Like IEAddTimer() but with microsecond resolution, for guide pulses and other short delays that must be precise. Timers run on a monotonic clock and are not moved by changes to the time of day.
+*
+* \param microsecs timer period in microseconds.
+* \param fp a pointer to the callback function.
+* \param userpointer a pointer to be passed to the callback function when called.
+* \return a unique id for use with IERmTimer().
+*/
+extern int  IEAddTimerUs (long microsecs, IE_TCF *fp, void *userpointer);
+
 /** \brief Remove the timer with the given \e timerid, as returned from IEAddTimer.
 *
 * \param timerid the timer callback ID returned from IEAddTimer().
@@ -31,6 +31,7 @@
 #include <locale.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <poll.h>
 #include <pthread.h>
 
 #include "lilxml.h"
@@ -42,18 +43,142 @@
 
 pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* 1 once indiserver said binaryBLOB='On', then IDSetBLOB() sends raw bytes */
+static int binaryBLOBs;
+
 #define MAXRBUF 2048
+#define BLOB64LINES 1024	/* 72 char base64 lines per BLOB fwrite() */
+#define MINCLIBUF 8192		/* first size of stdin read buffer */
+#define MAXCLIBUF (1024*1024)	/* stdin read buffer grows up to this */
+
+/* state of the reader of client messages on stdin */
+typedef struct {
+    char *buf;				/* read buffer */
+    int size;				/* bytes malloced for buf */
+    int pos;				/* bytes of buf cracked so far */
+    int len;				/* bytes of buf read */
+} CliReader;
+
+static CliReader clireader;
+
+/* write bloblen bytes at blob to fp in base64, broken into lines of 72 chars.
+ * a fixed number of lines is encoded and written at a time so memory used
+ * does not grow with the BLOB.
+ */
+static void
+fwriteBLOB64 (FILE *fp, const unsigned char *blob, int bloblen)
+{
+    const int rawchunk = 54*BLOB64LINES;	/* 54 bytes make 72 chars */
+    unsigned char *enc = malloc (72*BLOB64LINES + 1);
+    char *out = malloc (73*BLOB64LINES);
+    int i;
 
-/* Return 1 is property is already cached, 0 otherwise */
-int isPropDefined(const char *property_name)
+    if (!enc || !out) {
+        fprintf (stderr, "%s: no memory to encode BLOB\n", me);
+        free (enc);
+        free (out);
+        return;
+    }
+
+    for (i = 0; i < bloblen; i += rawchunk) {
+        int l = to64frombits (enc, blob+i, bloblen-i < rawchunk ? bloblen-i : rawchunk);
+        int j, o = 0;
+
+        for (j = 0; j < l; j += 72) {
+            int k = l-j < 72 ? l-j : 72;
+            memcpy (out+o, enc+j, k);
+            o += k;
+            out[o++] = '\n';
+        }
+        fwrite (out, 1, o, fp);
+    }
+
+    free (enc);
+    free (out);
+}
+
+/* open addressed hash of roCheck[] by propName, so dispatch() need not
+ * compare every defined property name on each command.
+ * each slot is an index into roCheck[] plus 1, or 0 if free.
+ */
+static int *roHash;
+static int roHashSize;			/* slots, a power of 2 */
+
+/* FNV-1a hash of a property name */
+static unsigned int
+hashName (const char *name)
 {
-    int i=0;
+    unsigned int h = 2166136261u;
 
-    for (i=0; i < nroCheck; i++)
-        if (!strcmp(property_name, roCheck[i].propName))
-            return 1;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return (h);
+}
 
-    return 0;
+/* return the roCheck[] entry of the named property, else NULL */
+static ROSC *
+findROSC (const char *name)
+{
+    unsigned int h;
+
+    if (roHashSize == 0)
+        return (NULL);
+
+    for (h = hashName(name) & (roHashSize-1); roHash[h];
+                                        h = (h+1) & (roHashSize-1)) {
+        ROSC *SC = &roCheck[roHash[h]-1];
+        if (!strcmp (SC->propName, name))
+            return (SC);
+    }
+
+    return (NULL);
+}
+
+/* put roCheck[i] in roHash */
+static void
+hashROSC (int i)
+{
+    unsigned int h;
+
+    for (h = hashName(roCheck[i].propName) & (roHashSize-1); roHash[h];
+                                        h = (h+1) & (roHashSize-1))
+        continue;
+    roHash[h] = i+1;
+}
+
+/* add the named property to roCheck[] unless already there */
+static void
+addROSC (const char *name, IPerm perm)
+{
+    ROSC *SC;
+    int i;
+
+    if (findROSC (name))
+        return;
+
+    roCheck = roCheck ? (ROSC *) realloc ( roCheck, sizeof(ROSC) * (nroCheck+1))
+                    : (ROSC *) malloc  ( sizeof(ROSC));
+    SC      = &roCheck[nroCheck++];
+
+    strncpy(SC->propName, name, MAXINDINAME-1);
+    SC->propName[MAXINDINAME-1] = '\0';
+    SC->perm = perm;
+
+    /* keep the table at most half full */
+    if (2*nroCheck > roHashSize) {
+        roHashSize = roHashSize ? 2*roHashSize : 64;
+        free (roHash);
+        roHash = (int *) calloc (roHashSize, sizeof(int));
+        for (i = 0; i < nroCheck; i++)
+            hashROSC (i);
+    } else
+        hashROSC (nroCheck-1);
+}
+
+/* Return 1 is property is already cached, 0 otherwise */
+int isPropDefined(const char *property_name)
+{
+    return (findROSC (property_name) != NULL);
 }
 
 /* output a string expanding special characters into xml/html escape sequences */
@@ -185,6 +310,12 @@ IEAddTimer (int millisecs, IE_TCF *fp, void *p)
 	return (addTimer (millisecs, (TCF*)fp, p));
 }
 
+int
+IEAddTimerUs (long microsecs, IE_TCF *fp, void *p)
+{
+	return (addTimerUs (microsecs, (TCF*)fp, p));
+}
+
 void
 IERmTimer (int timerid)
 {
@@ -216,6 +347,42 @@ IEDeferLoop0 (int maxms, int *flagp)
 	return (deferLoop0 (maxms, flagp));
 }
 
+/* find the named member of a vector for IUUpdate*(). member i is tried first
+ * since clients send members in the order they were defined, else fall back
+ * to IUFind*().
+ */
+static ISwitch *
+findSwitchAt (const ISwitchVectorProperty *svp, const char *name, int i)
+{
+    if (i < svp->nsp && !strcmp (svp->sp[i].name, name))
+        return (&svp->sp[i]);
+    return (IUFindSwitch (svp, name));
+}
+
+static INumber *
+findNumberAt (const INumberVectorProperty *nvp, const char *name, int i)
+{
+    if (i < nvp->nnp && !strcmp (nvp->np[i].name, name))
+        return (&nvp->np[i]);
+    return (IUFindNumber (nvp, name));
+}
+
+static IText *
+findTextAt (const ITextVectorProperty *tvp, const char *name, int i)
+{
+    if (i < tvp->ntp && !strcmp (tvp->tp[i].name, name))
+        return (&tvp->tp[i]);
+    return (IUFindText (tvp, name));
+}
+
+static IBLOB *
+findBLOBAt (const IBLOBVectorProperty *bvp, const char *name, int i)
+{
+    if (i < bvp->nbp && !strcmp (bvp->bp[i].name, name))
+        return (&bvp->bp[i]);
+    return (IUFindBLOB (bvp, name));
+}
+
 /* Update property switches in accord with states and names. */
 int 
 IUUpdateSwitch(ISwitchVectorProperty *svp, ISState *states, char *names[], int n)
@@ -235,7 +402,7 @@ IUUpdateSwitch(ISwitchVectorProperty *svp, ISState *states, char *names[], int n
  
  for (i = 0; i < n ; i++)
  {
-   sp = IUFindSwitch(svp, names[i]);
+   sp = findSwitchAt(svp, names[i], i);
 	 
    if (!sp)
    {
@@ -280,7 +447,7 @@ int IUUpdateNumber(INumberVectorProperty *nvp, double values[], char *names[], i
   
   for (i = 0; i < n; i++)
   {
-    np = IUFindNumber(nvp, names[i]);
+    np = findNumberAt(nvp, names[i], i);
     if (!np)
     {
     	nvp->s = IPS_IDLE;
@@ -300,7 +467,7 @@ int IUUpdateNumber(INumberVectorProperty *nvp, double values[], char *names[], i
   /* First loop checks for error, second loop set all values atomically*/
   for (i=0; i < n; i++)
   {
-    np = IUFindNumber(nvp, names[i]);
+    np = findNumberAt(nvp, names[i], i);
     np->value = values[i];  
   }
 
@@ -317,7 +484,7 @@ int IUUpdateText(ITextVectorProperty *tvp, char * texts[], char *names[], int n)
   
   for (i = 0; i < n; i++)
   {
-    tp = IUFindText(tvp, names[i]);
+    tp = findTextAt(tvp, names[i], i);
     if (!tp)
     {
     	tvp->s = IPS_IDLE;
@@ -329,7 +496,7 @@ int IUUpdateText(ITextVectorProperty *tvp, char * texts[], char *names[], int n)
   /* First loop checks for error, second loop set all values atomically*/
   for (i=0; i < n; i++)
   {
-    tp = IUFindText(tvp, names[i]);
+    tp = findTextAt(tvp, names[i], i);
     IUSaveText(tp, texts[i]);
   }
 
@@ -347,7 +514,7 @@ int IUUpdateBLOB(IBLOBVectorProperty *bvp, int sizes[], int blobsizes[], char *b
 
   for (i = 0; i < n; i++)
   {
-    bp = IUFindBLOB(bvp, names[i]);
+    bp = findBLOBAt(bvp, names[i], i);
     if (!bp)
     {
         bvp->s = IPS_IDLE;
@@ -359,7 +526,7 @@ int IUUpdateBLOB(IBLOBVectorProperty *bvp, int sizes[], int blobsizes[], char *b
   /* First loop checks for error, second loop set all values atomically*/
   for (i=0; i < n; i++)
   {
-    bp = IUFindBLOB(bvp, names[i]);
+    bp = findBLOBAt(bvp, names[i], i);
     IUSaveBLOB(bp, sizes[i], blobsizes[i], blobs[i], formats[i]);
   }
 
@@ -825,39 +992,89 @@ IUSnoopBLOB (XMLEle *root, IBLOBVectorProperty *bvp)
 	return (0);
 }
 
+/* crack the bytes read into cr->buf not yet cracked and dispatch each
+ * complete element. an IS* handler may call IEDeferLoop(), which can land
+ * back in clientMsgCB(), so the position is kept in cr, not here: the nested
+ * call then cracks what is left first, and only reads over buf once it is
+ * all taken.
+ */
+static void
+crackClient (CliReader *cr)
+{
+    char msg[1024];
+    int used;
+
+    while (cr->pos < cr->len) {
+        XMLEle *root = readXMLChunk (clixml, cr->buf + cr->pos,
+                                        cr->len - cr->pos, &used, msg);
+
+        cr->pos += used;
+        if (root) {
+            if (dispatch (root, msg) < 0)
+                fprintf (stderr, "%s dispatch error: %s\n", me, msg);
+            delXMLEle (root);
+        } else if (msg[0])
+            fprintf (stderr, "%s XML error: %s\n", me, msg);
+    }
+}
+
 /* callback when INDI client message arrives on stdin.
  * collect and dispatch when see outter element closure.
+ * read until nothing more is waiting, so a large BLOB or a burst of commands
+ * is handled in one call. the read buffer grows while reads fill it.
  * exit if OS trouble or see incompatable INDI version.
  * arg is not used.
  */
 void
 clientMsgCB (int fd, void *arg)
 {
-	char buf[1024], msg[1024], *bp;
+	CliReader *cr = &clireader;
+	struct pollfd pfd;
 	int nr;
 	arg=arg;
 
-	/* one read */
-	nr = read (fd, buf, sizeof(buf));
-	if (nr < 0) {
-	    fprintf (stderr, "%s: %s\n", me, strerror(errno));
-	    exit(1);
-	}
-	if (nr == 0) {
-	    fprintf (stderr, "%s: EOF\n", me);
-	    exit(1);
+	if (!cr->buf) {
+	    cr->size = MINCLIBUF;
+	    cr->buf = (char *) malloc (cr->size);
+	    if (!cr->buf) {
+		fprintf (stderr, "%s: no memory for stdin\n", me);
+		exit(1);
+	    }
 	}
 
-	/* crack and dispatch when complete */
-	for (bp = buf; nr-- > 0; bp++) {
-	    XMLEle *root = readXMLEle (clixml, *bp, msg);
-	    if (root) {
-		if (dispatch (root, msg) < 0)
-		    fprintf (stderr, "%s dispatch error: %s\n", me, msg);
-		delXMLEle (root);
-	    } else if (msg[0])
-		fprintf (stderr, "%s XML error: %s\n", me, msg);
-	}
+	/* finish any left by a call we are nested in, before reading on */
+	crackClient (cr);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	do {
+	    nr = read (fd, cr->buf, cr->size);
+	    if (nr < 0) {
+		fprintf (stderr, "%s: %s\n", me, strerror(errno));
+		exit(1);
+	    }
+	    if (nr == 0) {
+		fprintf (stderr, "%s: EOF\n", me);
+		exit(1);
+	    }
+
+	    /* crack and dispatch when complete */
+	    cr->pos = 0;
+	    cr->len = nr;
+	    crackClient (cr);
+
+	    /* a full read means more may be waiting, use more next time */
+	    if (nr < cr->size)
+		break;
+	    if (cr->size < MAXCLIBUF) {
+		char *nb = (char *) realloc (cr->buf, 2*cr->size);
+		if (nb) {
+		    cr->buf = nb;
+		    cr->size *= 2;
+		}
+	    }
+	} while (poll (&pfd, 1, 0) > 0 && (pfd.revents & (POLLIN|POLLHUP)));
 
 }
 
@@ -873,7 +1090,7 @@ dispatch (XMLEle *root, char msg[])
 
         char *rtag = tagXMLEle(root);
         XMLEle *ep;
-        int n,i=0;
+        int n;
 
         if (verbose)
             prXMLEle (stderr, root, 0);
@@ -890,21 +1107,11 @@ dispatch (XMLEle *root, char msg[])
             if (crackDN (root, &dev, &name, msg) < 0)
                 return (-1);
 
-            if (!isPropDefined(name))
+            /* ensure property is defined and not RO */
+            ROSC *SC = findROSC (name);
+            if (!SC || SC->perm == IP_RO)
                 return -1;
 
-            /* ensure property is not RO */
-            for (i=0; i < nroCheck; i++)
-            {
-              if (!strcmp(roCheck[i].propName, name))
-              {
-               if (roCheck[i].perm == IP_RO)
-                 return -1;
-               else
-                   break;
-              }
-            }
-
             /* seed for reallocs */
             if (!doubles) {
                 doubles = (double *) malloc (1);
@@ -953,21 +1160,11 @@ dispatch (XMLEle *root, char msg[])
             if (crackDN (root, &dev, &name, msg) < 0)
                 return (-1);
 
-            if (!isPropDefined(name))
+            /* ensure property is defined and not RO */
+            ROSC *SC = findROSC (name);
+            if (!SC || SC->perm == IP_RO)
                 return -1;
 
-            /* ensure property is not RO */
-            for (i=0; i < nroCheck; i++)
-            {
-              if (!strcmp(roCheck[i].propName, name))
-              {
-               if (roCheck[i].perm == IP_RO)
-                 return -1;
-               else
-                   break;
-              }
-            }
-
             /* seed for reallocs */
             if (!states) {
                 states = (ISState *) malloc (1);
@@ -1018,21 +1215,11 @@ dispatch (XMLEle *root, char msg[])
             if (crackDN (root, &dev, &name, msg) < 0)
                 return (-1);
 
-            if (!isPropDefined(name))
+            /* ensure property is defined and not RO */
+            ROSC *SC = findROSC (name);
+            if (!SC || SC->perm == IP_RO)
                 return -1;
 
-            /* ensure property is not RO */
-            for (i=0; i < nroCheck; i++)
-            {
-              if (!strcmp(roCheck[i].propName, name))
-              {
-               if (roCheck[i].perm == IP_RO)
-                 return -1;
-               else
-                   break;
-              }
-            }
-
             /* seed for reallocs */
             if (!texts) {
                 texts = (char **) malloc (1);
@@ -1078,7 +1265,7 @@ dispatch (XMLEle *root, char msg[])
             if (crackDN (root, &dev, &name, msg) < 0)
                 return (-1);
 
-            if (!isPropDefined(name))
+            if (!findROSC (name))
                 return -1;
 
             /* seed for reallocs */
@@ -1107,7 +1294,7 @@ dispatch (XMLEle *root, char msg[])
                             blobsizes = (int *) realloc(blobsizes,newsz);
                         }
                         blobs[n] = malloc (3*pcdatalenXMLEle(ep)/4);
-                        blobsizes[n] = from64tobits(blobs[n], pcdataXMLEle(ep));
+                        blobsizes[n] = from64tobits_fast(blobs[n], pcdataXMLEle(ep), pcdatalenXMLEle(ep));
                         names[n] = valuXMLAtt(na);
                         formats[n] = valuXMLAtt(fa);
                         sizes[n] = atoi(valuXMLAtt(sa));
@@ -1142,6 +1329,11 @@ dispatch (XMLEle *root, char msg[])
                 exit(1);
             }
 
+            /* server reads binary BLOBs? */
+            ap = findXMLAtt (root, "binaryBLOB");
+            if (ap && !strcmp (valuXMLAtt(ap), "On"))
+                binaryBLOBs = 1;
+
             /* ok */
             ap = findXMLAtt (root, "device");
             ISGetProperties (ap ? valuXMLAtt(ap) : NULL);
@@ -1440,19 +1632,13 @@ void IUSaveConfigBLOB (FILE *fp, const IBLOBVectorProperty *bvp)
     for (i = 0; i < bvp->nbp; i++)
     {
         IBLOB *bp = &bvp->bp[i];
-        unsigned char *encblob;
-        int j, l;
 
         fprintf (fp, "  <oneBLOB\n");
         fprintf (fp, "    name='%s'\n", bp->name);
         fprintf (fp, "    size='%d'\n", bp->size);
         fprintf (fp, "    format='%s'>\n", bp->format);
 
-        encblob = malloc (4*bp->bloblen/3+4);
-        l = to64frombits(encblob, bp->blob, bp->bloblen);
-        for (j = 0; j < l; j += 72)
-            fprintf (fp, "%.72s\n", encblob+j);
-        free (encblob);
+        fwriteBLOB64 (fp, bp->blob, bp->bloblen);
 
         fprintf (fp, "  </oneBLOB>\n");
     }
@@ -1466,7 +1652,6 @@ void
 IDDefText (const ITextVectorProperty *tvp, const char *fmt, ...)
 {
         int i;
-        ROSC *SC;
 
         pthread_mutex_lock(&stdout_mutex);
 
@@ -1502,16 +1687,8 @@ IDDefText (const ITextVectorProperty *tvp, const char *fmt, ...)
 
         printf ("</defTextVector>\n");
 
-        if (!isPropDefined(tvp->name))
-        {
-                /* Add this property to insure proper sanity check */
-                roCheck = roCheck ? (ROSC *) realloc ( roCheck, sizeof(ROSC) * (nroCheck+1))
-                                : (ROSC *) malloc  ( sizeof(ROSC));
-                SC      = &roCheck[nroCheck++];
-
-                strcpy(SC->propName, tvp->name);
-                SC->perm = tvp->p;
-        }
+        /* Add this property to insure proper sanity check */
+        addROSC (tvp->name, tvp->p);
 
         setlocale(LC_NUMERIC,orig);
         fflush (stdout);
@@ -1524,7 +1701,6 @@ void
 IDDefNumber (const INumberVectorProperty *n, const char *fmt, ...)
 {
         int i;
-        ROSC *SC;
 
         pthread_mutex_lock(&stdout_mutex);
 
@@ -1570,17 +1746,8 @@ IDDefNumber (const INumberVectorProperty *n, const char *fmt, ...)
 
         printf ("</defNumberVector>\n");
 
-        if (!isPropDefined(n->name))
-        {
-                /* Add this property to insure proper sanity check */
-                roCheck = roCheck ? (ROSC *) realloc ( roCheck, sizeof(ROSC) * (nroCheck+1))
-                                : (ROSC *) malloc  ( sizeof(ROSC));
-                SC      = &roCheck[nroCheck++];
-
-                strcpy(SC->propName, n->name);
-                SC->perm = n->p;
-
-        }
+        /* Add this property to insure proper sanity check */
+        addROSC (n->name, n->p);
 
         setlocale(LC_NUMERIC,orig);
         fflush (stdout);
@@ -1594,7 +1761,6 @@ IDDefSwitch (const ISwitchVectorProperty *s, const char *fmt, ...)
 
 {
         int i;
-        ROSC *SC;
 
         pthread_mutex_lock(&stdout_mutex);
 
@@ -1631,16 +1797,8 @@ IDDefSwitch (const ISwitchVectorProperty *s, const char *fmt, ...)
 
         printf ("</defSwitchVector>\n");
 
-        if (!isPropDefined(s->name))
-        {
-                /* Add this property to insure proper sanity check */
-                roCheck = roCheck ? (ROSC *) realloc ( roCheck, sizeof(ROSC) * (nroCheck+1))
-                                : (ROSC *) malloc  ( sizeof(ROSC));
-                SC      = &roCheck[nroCheck++];
-
-                strcpy(SC->propName, s->name);
-                SC->perm = s->p;
-        }
+        /* Add this property to insure proper sanity check */
+        addROSC (s->name, s->p);
 
         setlocale(LC_NUMERIC,orig);
         fflush (stdout);
@@ -1694,7 +1852,6 @@ void
 IDDefBLOB (const IBLOBVectorProperty *b, const char *fmt, ...)
 {
   int i;
-  ROSC *SC;
 
   pthread_mutex_lock(&stdout_mutex);
 
@@ -1729,16 +1886,8 @@ IDDefBLOB (const IBLOBVectorProperty *b, const char *fmt, ...)
 
         printf ("</defBLOBVector>\n");
 
-        if (!isPropDefined(b->name))
-        {
-                /* Add this property to insure proper sanity check */
-                roCheck = roCheck ? (ROSC *) realloc ( roCheck, sizeof(ROSC) * (nroCheck+1))
-                                : (ROSC *) malloc  ( sizeof(ROSC));
-                SC      = &roCheck[nroCheck++];
-
-                strcpy(SC->propName, b->name);
-                SC->perm = b->p;
-        }
+        /* Add this property to insure proper sanity check */
+        addROSC (b->name, b->p);
 
         setlocale(LC_NUMERIC,orig);
         fflush (stdout);
@@ -1931,24 +2080,31 @@ IDSetBLOB (const IBLOBVectorProperty *bvp, const char *fmt, ...)
 
         for (i = 0; i < bvp->nbp; i++) {
             IBLOB *bp = &bvp->bp[i];
-            unsigned char *encblob;
-            int j, l;
 
             printf ("  <oneBLOB\n");
             printf ("    name='%s'\n", bp->name);
             printf ("    size='%d'\n", bp->size);
+
+            /* just announce the bytes, they follow </setBLOBVector> */
+            if (binaryBLOBs) {
+                printf ("    format='%s'\n", bp->format);
+                printf ("    attached='%d'/>\n", bp->bloblen);
+                continue;
+            }
             printf ("    format='%s'>\n", bp->format);
 
-            encblob = malloc (4*bp->bloblen/3+4);
-            l = to64frombits(encblob, bp->blob, bp->bloblen);
-            for (j = 0; j < l; j += 72)
-                printf ("%.72s\n", encblob+j);
-            free (encblob);
+            fwriteBLOB64 (stdout, bp->blob, bp->bloblen);
 
             printf ("  </oneBLOB>\n");
         }
 
-  printf ("</setBLOBVector>\n");
+  if (binaryBLOBs) {
+      printf ("</setBLOBVector>");
+      for (i = 0; i < bvp->nbp; i++)
+          fwrite (bvp->bp[i].blob, 1, bvp->bp[i].bloblen, stdout);
+      printf ("\n");
+  } else
+      printf ("</setBLOBVector>\n");
   setlocale(LC_NUMERIC,orig);
   fflush (stdout);
 
@@ -2000,3 +2156,115 @@ int IUFindIndex (const char *needle, char **hay, unsigned int n)
 }
 
 
+#ifdef ROCHECK_BENCHMARK
+/* standalone benchmark of dispatch() on a driver with many properties, and
+ * of the roCheck[] lookup in it against the plain scan it replaced.
+ * built as rocheckbench with -DINDI_BENCHMARKS=ON, make benchmarks runs it.
+ */
+
+#include <sys/time.h>
+
+#define	NPROPS		2000		/* number vectors defined */
+#define	NCMDS		200000		/* commands timed */
+
+/* what indidrivermain.c would define */
+ROSC *roCheck;
+int nroCheck;
+int verbose;
+char *me = "rocheckbench";
+LilXML *clixml;
+
+static int nnew;			/* ISNewNumber() calls */
+
+void ISGetProperties (const char *dev) {}
+void ISNewSwitch (const char *dev, const char *name, ISState *states, char *names[], int n) {}
+void ISNewText (const char *dev, const char *name, char *texts[], char *names[], int n) {}
+void ISNewNumber (const char *dev, const char *name, double *values, char *names[], int n) { nnew++; }
+void ISNewBLOB (const char *dev, const char *name, int sizes[], int blobsizes[], char *blobs[], char *formats[], char *names[], int n) {}
+void ISSnoopDevice (XMLEle *root) {}
+
+static double
+nowS (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec/1e6);
+}
+
+/* the lookup dispatch() did before roHash, a scan for the name and
+ * another for its permission
+ */
+static ROSC *
+scanROSC (const char *name)
+{
+	ROSC *SC = NULL;
+	int i;
+
+	for (i = 0; i < nroCheck; i++)
+	    if (!strcmp (roCheck[i].propName, name))
+		break;
+	if (i == nroCheck)
+	    return (NULL);
+	for (i = 0; i < nroCheck; i++)
+	    if (!strcmp (roCheck[i].propName, name))
+		SC = &roCheck[i];
+	return (SC);
+}
+
+int
+main (void)
+{
+	static INumber np[NPROPS];
+	static INumberVectorProperty nvp[NPROPS];
+	XMLEle *cmds[10];
+	LilXML *lp = newLilXML();
+	char msg[MAXRBUF], buf[256];
+	int found;
+	double t0, t;
+	int i, used;
+
+	/* definitions go to stdout, as to indiserver */
+	if (!freopen ("/dev/null", "w", stdout))
+	    return (1);
+
+	for (i = 0; i < NPROPS; i++) {
+	    char *name = (char *) malloc (MAXINDINAME);
+	    snprintf (name, MAXINDINAME, "PROP_%d", i);
+	    IUFillNumber (&np[i], "VALUE", "Value", "%g", 0, 100, 1, 0);
+	    IUFillNumberVector (&nvp[i], &np[i], 1, "bench", name, name, "Main", IP_RW, 0, IPS_IDLE);
+	    IDDefNumber (&nvp[i], NULL);
+	}
+
+	/* commands to the last defined, the worst case for a scan */
+	for (i = 0; i < 10; i++) {
+	    snprintf (buf, sizeof(buf), "<newNumberVector device='bench' name='PROP_%d'>"
+	                "<oneNumber name='VALUE'>%d</oneNumber></newNumberVector>", NPROPS-1-i, i);
+	    cmds[i] = readXMLChunk (lp, buf, strlen(buf), &used, msg);
+	    if (!cmds[i]) {
+		fprintf (stderr, "bad command: %s\n", msg);
+		return (1);
+	    }
+	}
+
+	t0 = nowS();
+	for (i = 0; i < NCMDS; i++)
+	    dispatch (cmds[i%10], msg);
+	t = nowS() - t0;
+	fprintf (stderr, "dispatch: %d commands in %.3f s, %d handled\n", NCMDS, t, nnew);
+
+	t0 = nowS();
+	for (found = i = 0; i < NCMDS; i++)
+	    found += findROSC (nvp[NPROPS-1-i%10].name) != NULL;
+	t = nowS() - t0;
+	fprintf (stderr, "hashed lookup: %d names in %.3f s, %d found\n", NCMDS, t, found);
+
+	t0 = nowS();
+	for (found = i = 0; i < NCMDS; i++)
+	    found += scanROSC (nvp[NPROPS-1-i%10].name) != NULL;
+	t = nowS() - t0;
+	fprintf (stderr, "scanned lookup: %d names in %.3f s, %d found\n", NCMDS, t, found);
+
+	return (0);
+}
+#endif
@@ -36,19 +36,42 @@
  * drivers, subject to optimizations based on sniffing messages for matching
  * Devices and Properties. Since one message might be destined to more than
  * one client or device, they are queued and only removed after the last
- * consumer is finished. XMLEle are converted to linear strings before being
- * sent to optimize write system calls and avoid blocking to slow clients.
+ * consumer is finished. Messages are forwarded as the raw bytes received, only
+ * their start tag is parsed for routing, and a large one is handed from its
+ * reader to the queue without copying.
  * Clients that get more than maxqsiz bytes behind are shut down.
+ * All fds are nonblocking and drained until EAGAIN. Where available an
+ * edge-triggered epoll core dispatches only the ready fds, otherwise
+ * (or when built with WITH_EPOLL off) select() is used, which is limited to
+ * FD_SETSIZE fds.
+ * A client may send <enableConflate>On</enableConflate> to have a queued
+ *   set*Vector that is not yet sent replaced by a newer one for the same
+ *   property, so a slow client sees the latest state instead of falling
+ *   maxqsiz behind. WithBLOBs also does so for setBLOBVector, Off stops.
+ * With -t, messages to clients larger than -b KB are written by a pool of
+ *   threads, the main loop keeps routing meanwhile. A client's socket belongs
+ *   to one thread at a time so its stream stays in order.
+ * A peer that says binaryBLOB='On' in its getProperties may be sent each
+ *   oneBLOB of a setBLOBVector as an empty element with attached='N', its N
+ *   raw bytes following the </setBLOBVector> in order, instead of as base64.
+ *   We say so to our drivers and remote servers, and convert back to base64
+ *   once per message for any client or snooping driver that did not.
  */
 
 #include "config.h"
 
+/* use the edge-triggered epoll core unless built for the portable select() loop */
+#if defined(WITH_EPOLL) && defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <signal.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <time.h>
 #include <fcntl.h>
@@ -56,21 +79,40 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <pthread.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#ifdef USE_EPOLL
+#include <stdint.h>
+#include <sys/epoll.h>
+#endif
 
 #include "lilxml.h"
 #include "indiapi.h"
+#include "base64.h"
 #include "fq.h"
 
 #define INDIPORT        7624    /* default TCP/IP port to listen */
 #define	REMOTEDVR       (-1234)	/* invalid PID to flag remote drivers */
 #define MAXSBUF         512
 #define	MAXRBUF         4096	/* max read buffering here */
-#define	MAXWSIZ         4096	/* max bytes/write */
+#define	MAXWSIZ         4096	/* Msg local buf size */
+#define	MSGSMALL        512     /* Msg local buf size for small messages */
+#define	MAXMSGPOOL      1024    /* max free Msgs kept per size class */
+#define	MAXIOV          64      /* max Msgs gathered per writev() */
 #define	DEFMAXQSIZ      64		/* default max q behind, MB */
 #define DEFMAXRESTART   10      /* default max restarts */
+#define DEFWTHRESH      256     /* default KB of a Msg for a write thread */
+#define MAXEVENTS       64      /* max epoll events handled per wakeup */
+#define MAXFRAME        (1024*1024) /* larger XMLFrame bufs are not reused */
+#define MAXELEMENT      INT_MAX /* max bytes of one element and its BLOBs */
+#define NROUTES         256     /* initial hash buckets in routes[] */
+#define NCONF           64      /* initial Conf slots of a conflating client */
+#define MAXCONF         4096    /* max Conf slots of a conflating client */
+#define MAXCONFTAG      32      /* max len of a conflated tag, with \0 */
 
 #ifdef OSX_EMBEDED_MODE
 #define LOGNAME "/Users/%s/Library/Logs/indiserver.log"
@@ -79,13 +121,62 @@
 
 
 /* associate a usage count with queuded client or device message */
-typedef struct {
+typedef struct Msg {
     int count;				/* number of consumers left */
     unsigned long cl;			/* content length */
-    char *cp;				/* content: buf or malloced */
-    char buf[MAXWSIZ];		/* local buf for most messages */
+    char *cp;				/* content: buf or malloced, or next
+                                         * free Msg while in pool */
+    int pool;				/* size class, index to msgpool[] */
+    unsigned long xmllen;		/* bytes before binary BLOBs, else 0 */
+    struct Msg *text;			/* base64 version made by textMsg() */
+    unsigned dhash;			/* routeHash() of device, "" */
+    unsigned phash;			/* routeHash() of device, name */
+    char buf[];				/* local buf for most messages */
 } Msg;
 
+/* framing state of the XML arriving on one connection */
+typedef struct {
+    char *buf;				/* malloced bytes of current element */
+    size_t nbuf;			/* bytes used in buf, sans trailing \0 */
+    size_t mbuf;			/* bytes malloced for buf */
+    int rawok;				/* 1 if peer may attach binary BLOBs */
+    int depth;				/* elements open */
+    int intag;				/* 1 while between < and > */
+    int kind;				/* tag kind, '<', '/', '!', '?' or 0 if new */
+    int quote;				/* delimiter while in attribute value */
+    int lastc;				/* last char in tag, to find /> */
+    int headlen;			/* length of root start tag, with > */
+    int tagstart;			/* offset in buf of latest tag */
+    long attached;			/* binary BLOB bytes after the root */
+    long rawleft;			/* attached bytes still to come */
+    int xmllen;				/* bytes of the element itself */
+    int complete;			/* 1 when buf holds a whole element */
+} XMLFrame;
+
+/* client queues: small control and telemetry messages are sent ahead of any
+ * bulk BLOBs queued before them, switching only between whole messages.
+ */
+typedef enum {LANE_CTL=0, LANE_BULK, NLANES} Lane;
+
+/* what a client asked to have conflated with enableConflate, OFF is the
+ * default. ON replaces a queued set*Vector not yet sent with a newer one
+ * for the same device and property, BLOBS does so for setBLOBVector too.
+ */
+typedef enum {C_OFF=0, C_ON, C_BLOBS} Conflate;
+
+/* a set*Vector queued for a conflating client, hashed by tag, dev and name.
+ * it is still in the queue while seq is not yet popped from its lane.
+ */
+typedef struct {
+    Msg *mp;				/* queued Msg, NULL if slot unused */
+    unsigned long seq;			/* npush[lane] when mp was queued */
+    unsigned hash;			/* confHash() of tag, dev and name */
+    Lane lane;				/* queue mp is on */
+    char tag[MAXCONFTAG];
+    char dev[MAXINDIDEVICE];
+    char name[MAXINDINAME];
+} Conf;
+
 /* BLOB handling, NEVER is the default */
 typedef enum {B_NEVER=0, B_ALSO, B_ONLY} BLOBHandling;
 
@@ -104,6 +195,31 @@ typedef struct {
 } Property;
 */
 
+/* one consumer of a Route: a clinfo[] or dvrinfo[] slot and the index of
+ * the matching entry in its props[] or sprops[], if any.
+ */
+typedef struct {
+    int slot;
+    int prop;
+} Sub;
+
+/* everyone who wants messages for one device and property, name "" for all
+ * properties of dev. hashed in routes[] so routing a message only visits its
+ * interested consumers.
+ */
+typedef struct Route {
+    struct Route *next;			/* hash chain */
+    unsigned hash;			/* routeHash() of dev and name */
+    char dev[MAXINDIDEVICE];
+    char name[MAXINDINAME];
+    Sub *cl;				/* interested clients, by props[] */
+    int ncl;				/* n entries in cl[] */
+    Sub *sd;				/* snooping drivers, by sprops[] */
+    int nsd;				/* n entries in sd[] */
+    Sub *own;				/* drivers serving dev, name "" only */
+    int nown;				/* n entries in own[] */
+} Route;
+
 struct
 {
     const char *name;                      /* Path to FIFO for dynamic startups & shutdowns of drivers */
@@ -120,8 +236,21 @@ typedef struct {
     BLOBHandling blob;			/* when to send setBLOBs */
     int s;				/* socket for this client */
     LilXML *lp;				/* XML parsing context */
-    FQ *msgq;				/* Msg queue */
+    XMLFrame xf;			/* XML framing context */
+    FQ *msgq[NLANES];			/* Msg queue for each Lane */
+    Lane lane;				/* lane of current Msg */
+    unsigned long qbytes;		/* unsent bytes on all msgq[] */
     unsigned int nsent;				/* bytes of current Msg sent so far */
+    unsigned rseq;			/* routeseq when last routed to */
+    int rprop;				/* props[] matching that route, or -1 */
+    int wbusy;				/* 1 while a write thread has s */
+    int binblob;			/* 1 if client takes binary BLOBs */
+    unsigned long npush[NLANES];	/* Msgs ever pushed on each msgq[] */
+    unsigned long npop[NLANES];		/* Msgs ever popped from each msgq[] */
+    Conflate conflate;			/* what to conflate for this client */
+    Conf *conf;				/* malloced hash of queued set*Vector */
+    int nconf;				/* n slots in conf[], power of 2 */
+    unsigned long nconflated;		/* Msgs replaced by a newer one */
 } ClInfo;
 static ClInfo *clinfo;			/*  malloced pool of clients */
 static int nclinfo;			/* n total (not active) */
@@ -145,8 +274,12 @@ typedef struct {
     int efd;				/* stderr from driver, if local */
     int restarts;			/* times process has been restarted */
     LilXML *lp;				/* XML parsing context */
+    XMLFrame xf;			/* XML framing context */
     FQ *msgq;				/* Msg queue */
+    unsigned long qbytes;		/* unsent bytes on msgq */
     unsigned int nsent;			/* bytes of current Msg sent so far */
+    unsigned rseq;			/* routeseq when last routed to */
+    int rprop;				/* sprops[] matching that route */
 } DvrInfo;
 static DvrInfo *dvrinfo;		/* malloced array of drivers */
 static int ndvrinfo;			/* n total */
@@ -158,8 +291,57 @@ static int lsocket;			/* listen socket */
 static char *ldir;			/* where to log driver messages */
 static int maxqsiz = (DEFMAXQSIZ*1024*1024); /* kill if these bytes behind */
 static int maxrestarts = DEFMAXRESTART;
+static int nwthreads;			/* write threads, 0 to write inline */
+static unsigned long wthresh = DEFWTHRESH*1024; /* Msg bytes for a thread */
 static int terminateddrv = 0;
 
+/* free Msgs for reuse, by size class of their local buf */
+static const int msgbufsiz[2] = {MSGSMALL, MAXWSIZ};
+static Msg *msgpool[2];			/* linked through cp */
+static int nmsgpool[2];			/* n in each msgpool[] */
+static unsigned long msgpoolhits;	/* newMsg() served from a pool */
+static unsigned long msgpoolmisses;	/* newMsg() had to malloc */
+static volatile sig_atomic_t wantstats;	/* SIGUSR1 seen */
+
+/* routing index */
+static Route **routes;			/* malloced hash buckets */
+static int nroutes;			/* n buckets in routes[], power of 2 */
+static int nroute;			/* n Routes in all buckets */
+static unsigned routeseq;		/* bumped for each message routed */
+static int *allcl;			/* clinfo[] slots with allprops */
+static int nallcl;			/* n entries in allcl[] */
+static int *clroute;			/* clinfo[] slots found by routeClients() */
+static int nclroute;			/* n entries malloced in clroute[] */
+
+/* a large Msg handed to a write thread. the job holds its own count on mp
+ * so the client may be shut down meanwhile; s is closed when it returns.
+ */
+typedef struct {
+    int slot;				/* clinfo[] index */
+    int fd;				/* client socket */
+    Msg *mp;				/* message being written */
+    unsigned long off;			/* bytes of mp sent so far */
+    int err;				/* errno if write failed, else 0 */
+} WJob;
+static pthread_mutex_t wlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wcond = PTHREAD_COND_INITIALIZER;
+static FQ *wtodo;			/* WJobs waiting for a thread */
+static FQ *wdone;			/* WJobs finished, for writersDone() */
+static int wpipe[2] = {-1, -1};		/* threads poke main loop on [1] */
+
+#ifdef USE_EPOLL
+static int epfd = -1;			/* epoll instance for all our fds */
+
+/* what an epoll event refers to. packed into epoll_data.u64 along with the
+ * clinfo[]/dvrinfo[] index and the fd, since those arrays may be realloced.
+ */
+typedef enum {EV_LISTEN, EV_FIFO, EV_CLIENT, EV_DVR, EV_DVRW, EV_DVRERR,
+                                                        EV_WRITER} EvKind;
+
+/* clients and drivers are edge-triggered, they are drained until EAGAIN */
+#define CLEVENTS    (EPOLLIN|EPOLLOUT|EPOLLET)
+#endif
+
 static void logStartup(int ac, char *av[]);
 static void usage (void);
 static void noZombies (void);
@@ -171,12 +353,24 @@ static void newFIFO(void);
 static void newClient (void);
 static int newClSocket (void);
 static void shutdownClient (ClInfo *cp);
+static void setNonBlock (int fd);
 static int readFromClient (ClInfo *cp);
+static int clientXML (ClInfo *cp, char buf[], ssize_t nr);
 static void startDvr (DvrInfo *dp);
 static void startLocalDvr (DvrInfo *dp);
 static void startRemoteDvr (DvrInfo *dp);
 static int openINDIServer (char host[], int indi_port);
 static void shutdownDvr (DvrInfo *dp, int restart);
+#ifdef USE_EPOLL
+static void epollCtl (int op, int fd, uint32_t events, EvKind kind, int idx);
+static void watchClient (ClInfo *cp);
+static void watchDvr (DvrInfo *dp);
+static void unwatchDvr (DvrInfo *dp);
+#endif
+static void pushClientMsg (ClInfo *cp, Msg *mp, Lane lane);
+static int nClientMsg (ClInfo *cp);
+static Lane ctlLane (ClInfo *cp, unsigned dh, unsigned ph, int alldev);
+static void pushDriverMsg (DvrInfo *dp, Msg *mp);
 static int isDeviceInDriver(const char *dev, DvrInfo *dp);
 static void q2RDrivers (const char *dev, Msg *mp, XMLEle *root);
 static void q2SDrivers (int isblob, const char *dev, const char *name, Msg *mp,
@@ -188,15 +382,51 @@ static void addSDevice (DvrInfo *dp, const char *dev, const char *name);
 static Property *findSDevice (DvrInfo *dp, const char *dev, const char *name);
 static void addClDevice (ClInfo *cp, const char *dev, const char *name, int isblob);
 static int findClDevice (ClInfo *cp, const char *dev, const char *name);
+static unsigned routeHash (const char *dev, const char *name);
+static Route *findRoute (const char *dev, const char *name, int create);
+static void addSub (Sub **subsp, int *nsubsp, int slot, int prop);
+static void rmSub (Sub *subs, int *nsubsp, int slot);
+static void routeDvrDevice (DvrInfo *dp, const char *dev);
+static void unrouteDvr (DvrInfo *dp);
+static void unrouteClient (ClInfo *cp);
+static int routeClients (ClInfo *notme, const char *dev, const char *name);
+static int addClRoute (ClInfo *notme, int slot, int prop, int n);
+static void crackConflate (const char *enableConflate, ClInfo *cp);
+static int conflateClientMsg (ClInfo *cp, Msg *mp, XMLEle *root, Lane lane);
+static unsigned confHash (const char *tag, const char *dev, const char *name);
+static int queuedConf (ClInfo *cp, Conf *cf);
+static void growConf (ClInfo *cp);
 static int readFromDriver (DvrInfo *dp);
+static int driverXML (DvrInfo *dp, char buf[], ssize_t nr);
 static int stderrFromDriver (DvrInfo *dp);
-static int msgQSize (FQ *q);
-static void setMsgXMLEle (Msg *mp, XMLEle *root);
-static void setMsgStr (Msg *mp, char *str);
+static int frameXML (XMLFrame *xf, const char buf[], int nr, int *done,
+    char err[]);
+static int frameRaw (XMLFrame *xf, const char buf[], int nr, int *done,
+    char err[]);
+static long attachedFrame (XMLFrame *xf);
+static int growFrame (XMLFrame *xf, const char *s, int n, char err[]);
+static void doneFrame (XMLFrame *xf);
+static void freeFrame (XMLFrame *xf);
+static int fullFrame (XMLFrame *xf);
+static XMLEle *parseFrame (LilXML *lp, XMLFrame *xf, int full, char err[]);
+static Msg *newMsgXMLEle (XMLEle *root);
+static Msg *newMsgFrame (XMLFrame *xf);
+static Msg *textMsg (Msg *mp, XMLEle *root);
+static void doneMsg (Msg *mp);
+static Msg *newMsgStr (char *str);
+static Msg *newMsg (unsigned long cl);
 static void freeMsg (Msg *mp);
-static Msg *newMsg (void);
+static void logStats (void);
+static void onSIGUSR1 (int sig);
+static void statsOnSIGUSR1 (void);
+static void startWriters (void);
+static void *writerThread (void *arg);
+static void writeJob (WJob *jp);
+static void writersDone (void);
 static int sendClientMsg (ClInfo *cp);
 static int sendDriverMsg (DvrInfo *cp);
+static int msgQIOV (FQ *q, unsigned int nsent, struct iovec iov[]);
+static int msgQSent (FQ *q, unsigned int *nsentp, ssize_t nw);
 static void crackBLOB (const char *enableBLOB, BLOBHandling *bp);
 static void crackBLOBHandling(const char *dev, const char *name, const char *enableBLOB, ClInfo *cp);
 static void traceMsg (XMLEle *root);
@@ -275,6 +505,26 @@ main (int ac, char *av[])
                     maxrestarts=0;
                 ac--;
                 break;
+            case 't':
+                if (ac < 2) {
+                    fprintf (stderr, "-t requires number of write threads\n");
+                    usage();
+                }
+                nwthreads = atoi(*++av);
+                if (nwthreads < 0)
+                    nwthreads = 0;
+                ac--;
+                break;
+            case 'b':
+                if (ac < 2) {
+                    fprintf (stderr, "-b requires KB for write threads\n");
+                    usage();
+                }
+                wthresh = 1024UL*atoi(*++av);
+                if (wthresh < MAXWSIZ)
+                    wthresh = MAXWSIZ;
+                ac--;
+                break;
             case 'v':
                 verbose++;
                 break;
@@ -293,6 +543,22 @@ main (int ac, char *av[])
     noZombies();
     noSIGPIPE();
 
+    statsOnSIGUSR1();
+
+#ifdef USE_EPOLL
+    /* event core must exist before any driver or client fd is opened */
+    epfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        fprintf (stderr, "%s: epoll_create1: %s\n", indi_tstamp(NULL),
+                                strerror(errno));
+        Bye();
+    }
+#endif
+
+    /* spin up write threads, if wanted */
+    if (nwthreads > 0)
+        startWriters();
+
     /* realloc seed for client pool */
     clinfo = (ClInfo *) malloc (1);
     nclinfo = 0;
@@ -314,8 +580,13 @@ main (int ac, char *av[])
     indiFIFO();
 
     /* handle new clients and all io */
-    while (1)
+    while (1) {
         indiRun();
+        if (wantstats) {
+            wantstats = 0;
+            logStats();
+        }
+    }
 
     /* whoa! */
     fprintf (stderr, "unexpected return from main\n");
@@ -346,7 +617,10 @@ usage(void)
         fprintf (stderr, " -m m     : kill client if gets more than this many MB behind, default %d\n", DEFMAXQSIZ);
         fprintf (stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
         fprintf (stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
+        fprintf (stderr, " -t t     : write large messages to clients from t threads, default 0 (inline)\n");
+        fprintf (stderr, " -b b     : messages of at least this many KB are large, default %d\n", DEFWTHRESH);
         fprintf (stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+        fprintf (stderr, "            A \"stats\" line, or SIGUSR1, prints queue and Msg pool stats.\n");
         fprintf (stderr, " -v       : show key events, no traffic\n");
         fprintf (stderr, " -vv      : -v + key message content\n");
         fprintf (stderr, " -vvv     : -vv + complete xml\n");
@@ -355,6 +629,25 @@ usage(void)
     exit (2);
 }
 
+/* note stats were asked for, main loop prints them after indiRun() */
+static void
+onSIGUSR1 (int sig)
+{
+    (void) sig;
+    wantstats = 1;
+}
+
+/* arrange for SIGUSR1 to dump stats */
+static void
+statsOnSIGUSR1()
+{
+    struct sigaction sa;
+    sa.sa_handler = onSIGUSR1;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    (void)sigaction(SIGUSR1, &sa, NULL);
+}
+
 /* arrange for no zombies if drivers die */
 static void
 noZombies()
@@ -428,7 +721,7 @@ static void
 startLocalDvr (DvrInfo *dp)
 {
     Msg *mp;
-    char buf[32];
+    char buf[64];
     int rp[2], wp[2], ep[2];
     int pid;
 
@@ -522,23 +815,31 @@ startLocalDvr (DvrInfo *dp)
     dp->rfd = rp[0];
     dp->wfd = wp[1];
     dp->efd = ep[0];
+    setNonBlock (dp->rfd);
+    setNonBlock (dp->wfd);
+    setNonBlock (dp->efd);
     dp->lp = newLilXML();
+    arenaLilXML (dp->lp, 1);
     dp->msgq = newFQ(1);
     dp->sprops = (Property*) malloc (1);	/* seed for realloc */
     dp->nsprops = 0;
     dp->nsent = 0;
+    dp->qbytes = 0;
     dp->active = 1;
     dp->ndev = 0;
     dp->dev = (char **) malloc(sizeof(char *));
 
+#ifdef USE_EPOLL
+    watchDvr (dp);
+#endif
+
     /* first message primes driver to report its properties -- dev known
      * if restarting
      */
-    mp = newMsg();
-    pushFQ (dp->msgq, mp);
-    sprintf (buf, "<getProperties version='%g'/>\n", INDIV);
-    setMsgStr (mp, buf);
-    mp->count++;
+    sprintf (buf, "<getProperties version='%g' binaryBLOB='On'/>\n", INDIV);
+    mp = newMsgStr (buf);
+    pushDriverMsg (dp, mp);
+    dp->xf.rawok = 1;
 
     if (verbose > 0)
         fprintf (stderr, "%s: Driver %s: pid=%d rfd=%d wfd=%d efd=%d\n",
@@ -571,11 +872,14 @@ startRemoteDvr (DvrInfo *dp)
     dp->pid = REMOTEDVR;
     dp->rfd = sockfd;
     dp->wfd = sockfd;
+    setNonBlock (sockfd);
     dp->lp = newLilXML();
+    arenaLilXML (dp->lp, 1);
     dp->msgq = newFQ(1);
     dp->sprops = (Property*) malloc (1);	/* seed for realloc */
     dp->nsprops = 0;
     dp->nsent = 0;
+    dp->qbytes = 0;
     dp->active = 1;
     dp->ndev = 1;
     dp->dev = (char **) malloc(sizeof(char *));
@@ -586,16 +890,20 @@ startRemoteDvr (DvrInfo *dp)
     dp->dev[0] = (char *) malloc(MAXINDIDEVICE * sizeof(char));
     strncpy (dp->dev[0], dev, MAXINDIDEVICE-1);
     dp->dev[0][MAXINDIDEVICE-1] = '\0';
+    routeDvrDevice (dp, dp->dev[0]);
 
     /* Sending getProperties with device lets remote server limit its
      * outbound (and our inbound) traffic on this socket to this device.
      */
-    mp = newMsg();
-    pushFQ (dp->msgq, mp);
-    sprintf (buf, "<getProperties device='%s' version='%g'/>\n",
+#ifdef USE_EPOLL
+    watchDvr (dp);
+#endif
+
+    sprintf (buf, "<getProperties device='%s' version='%g' binaryBLOB='On'/>\n",
              dp->dev[0], INDIV);
-    setMsgStr (mp, buf);
-    mp->count++;
+    mp = newMsgStr (buf);
+    pushDriverMsg (dp, mp);
+    dp->xf.rawok = 1;
 
     if (verbose > 0)
         fprintf (stderr, "%s: Driver %s: socket=%d\n", indi_tstamp(NULL),
@@ -683,6 +991,10 @@ indiListen ()
 
     /* ok */
     lsocket = sfd;
+#ifdef USE_EPOLL
+    /* level-triggered, newClient() accepts one per wakeup */
+    epollCtl (EPOLL_CTL_ADD, lsocket, EPOLLIN, EV_LISTEN, 0);
+#endif
     if (verbose > 0)
         fprintf (stderr, "%s: listening to port %d on fd %d\n",
                             indi_tstamp(NULL), port, sfd);
@@ -691,6 +1003,10 @@ indiListen ()
 /* Attempt to open up FIFO */
 static void indiFIFO(void)
 {
+#ifdef USE_EPOLL
+    if (fifo.fd > 0)
+        epoll_ctl (epfd, EPOLL_CTL_DEL, fifo.fd, NULL);
+#endif
     close(fifo.fd);
     fifo.fd=-1;
 
@@ -704,10 +1020,146 @@ static void indiFIFO(void)
            fprintf(stderr, "%s: open(%s): %s.\n", indi_tstamp(NULL), fifo.name, strerror(errno));
            Bye();
        }
+
+#ifdef USE_EPOLL
+       /* level-triggered, newFIFO() reads until empty then reopens */
+       epollCtl (EPOLL_CTL_ADD, fifo.fd, EPOLLIN, EV_FIFO, 0);
+#endif
+    }
+
+}
+
+#ifdef USE_EPOLL
+
+/* service traffic from clients and drivers.
+ * only the fds epoll reports ready are visited. a handler may shut down or
+ * restart any client or driver so each event is checked against the current
+ * fd of its slot first; all fds are nonblocking so a stale event is harmless.
+ */
+static void
+indiRun(void)
+{
+    struct epoll_event events[MAXEVENTS];
+    int i, n;
+
+    /* wait for action */
+    n = epoll_wait (epfd, events, MAXEVENTS, -1);
+    if (n < 0) {
+        if (errno == EINTR)
+            return;
+        fprintf (stderr, "%s: epoll_wait: %s\n", indi_tstamp(NULL),
+                                strerror(errno));
+        Bye();
+    }
+
+    for (i = 0; i < n; i++) {
+        uint32_t ev = events[i].events;
+        uint64_t u = events[i].data.u64;
+        EvKind kind = (EvKind)(u >> 56);
+        int idx = (int)((u >> 32) & 0xffffff);
+        int fd = (int)(u & 0xffffffff);
+
+        switch (kind) {
+        case EV_LISTEN:
+            newClient();
+            break;
+
+        case EV_FIFO:
+            if (fd == fifo.fd)
+                newFIFO();
+            break;
+
+        case EV_WRITER:
+            writersDone();
+            break;
+
+        case EV_CLIENT: {
+            ClInfo *cp = &clinfo[idx];
+            if (idx >= nclinfo || !cp->active || cp->s != fd)
+                break;
+            if (ev & (EPOLLIN|EPOLLHUP|EPOLLERR))
+                readFromClient (cp);
+            if ((ev & EPOLLOUT) && cp->active && cp->s == fd
+                                            && nClientMsg(cp) > 0)
+                sendClientMsg (cp);
+            break;
+            }
+
+        case EV_DVR:		/* FALLTHRU */
+        case EV_DVRW:		/* FALLTHRU */
+        case EV_DVRERR: {
+            DvrInfo *dp = &dvrinfo[idx];
+            if (idx >= ndvrinfo || !dp->active)
+                break;
+            if (kind == EV_DVRERR) {
+                if (fd == dp->efd)
+                    stderrFromDriver (dp);
+                break;
+            }
+            if (kind == EV_DVR && fd == dp->rfd
+                                && (ev & (EPOLLIN|EPOLLHUP|EPOLLERR)))
+                readFromDriver (dp);
+            if ((ev & (EPOLLOUT|EPOLLERR)) && dp->active && fd == dp->wfd
+                                            && nFQ(dp->msgq) > 0)
+                sendDriverMsg (dp);
+            break;
+            }
+        }
+    }
+}
+
+/* add, modify or remove fd in epfd, tagging it with kind and index */
+static void
+epollCtl (int op, int fd, uint32_t events, EvKind kind, int idx)
+{
+    struct epoll_event ev;
+
+    memset (&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = ((uint64_t)kind << 56) | ((uint64_t)(idx & 0xffffff) << 32)
+                                                    | (uint32_t)fd;
+    if (epoll_ctl (epfd, op, fd, &ev) < 0) {
+        fprintf (stderr, "%s: epoll_ctl(%d): %s\n", indi_tstamp(NULL), fd,
+                                strerror(errno));
+        Bye();
+    }
+}
+
+/* start watching the given new client */
+static void
+watchClient (ClInfo *cp)
+{
+    epollCtl (EPOLL_CTL_ADD, cp->s, CLEVENTS, EV_CLIENT, cp - clinfo);
+}
+
+/* start watching all fds of the given newly started driver */
+static void
+watchDvr (DvrInfo *dp)
+{
+    int idx = dp - dvrinfo;
+
+    if (dp->pid == REMOTEDVR) {
+        epollCtl (EPOLL_CTL_ADD, dp->rfd, CLEVENTS, EV_DVR, idx);
+    } else {
+        epollCtl (EPOLL_CTL_ADD, dp->rfd, EPOLLIN|EPOLLET, EV_DVR, idx);
+        epollCtl (EPOLL_CTL_ADD, dp->wfd, EPOLLOUT|EPOLLET, EV_DVRW, idx);
+        epollCtl (EPOLL_CTL_ADD, dp->efd, EPOLLIN|EPOLLET, EV_DVRERR, idx);
     }
+}
 
+/* stop watching all fds of the given driver, before they are closed */
+static void
+unwatchDvr (DvrInfo *dp)
+{
+    epoll_ctl (epfd, EPOLL_CTL_DEL, dp->rfd, NULL);
+    if (dp->pid != REMOTEDVR) {
+        epoll_ctl (epfd, EPOLL_CTL_DEL, dp->wfd, NULL);
+        epoll_ctl (epfd, EPOLL_CTL_DEL, dp->efd, NULL);
+    }
 }
 
+#else
+
 /* service traffic from clients and drivers */
 static void
 indiRun(void)
@@ -731,12 +1183,19 @@ indiRun(void)
         if (lsocket > maxfd)
                 maxfd = lsocket;
 
+    /* and for write threads finishing */
+    if (wpipe[0] >= 0) {
+        FD_SET(wpipe[0], &rs);
+        if (wpipe[0] > maxfd)
+            maxfd = wpipe[0];
+    }
+
     /* add all client readers and client writers with work to send */
     for (i = 0; i < nclinfo; i++) {
         ClInfo *cp = &clinfo[i];
         if (cp->active) {
         FD_SET(cp->s, &rs);
-        if (nFQ(cp->msgq) > 0)
+        if (nClientMsg(cp) > 0 && !cp->wbusy)
             FD_SET(cp->s, &ws);
         if (cp->s > maxfd)
             maxfd = cp->s;
@@ -770,6 +1229,8 @@ indiRun(void)
     /* wait for action */
     s = select (maxfd+1, &rs, &ws, NULL, NULL);
     if (s < 0) {
+        if (errno == EINTR)
+            return;
         fprintf (stderr, "%s: select(%d): %s\n", indi_tstamp(NULL), maxfd+1,
                                 strerror(errno));
         Bye();
@@ -783,6 +1244,12 @@ indiRun(void)
             s--;
         }
 
+    /* write thread done? */
+    if (s > 0 && wpipe[0] >= 0 && FD_ISSET(wpipe[0], &rs)) {
+        writersDone();
+        s--;
+    }
+
     /* new client? */
     if (s > 0 && FD_ISSET(lsocket, &rs)) {
         newClient();
@@ -827,12 +1294,86 @@ indiRun(void)
     }
 }
 
+#endif /* USE_EPOLL */
+
+/* queue Msg mp for the given client on the given lane */
+static void
+pushClientMsg (ClInfo *cp, Msg *mp, Lane lane)
+{
+#ifdef USE_EPOLL
+    /* an idle socket has already reported its EPOLLOUT edge, rearm so the
+     * next wait reports it again if it is still writable.
+     */
+    if (nClientMsg(cp) == 0)
+        epollCtl (EPOLL_CTL_MOD, cp->s, CLEVENTS, EV_CLIENT, cp - clinfo);
+#endif
+    mp->count++;
+    cp->qbytes += mp->cl;
+    cp->npush[lane]++;
+    pushFQ (cp->msgq[lane], mp);
+}
+
+/* return number of Msgs queued for cp on all lanes */
+static int
+nClientMsg (ClInfo *cp)
+{
+    int i, n = 0;
+
+    for (i = 0; i < NLANES; i++)
+        n += nFQ(cp->msgq[i]);
+    return (n);
+}
+
+/* return the lane for a non-BLOB message to cp whose route hashes are dh
+ * for its device and ph for its property. it goes on the bulk lane, behind
+ * them, while a BLOB for the same property, or for any property of the
+ * device if alldev, is still queued there, so it can not overtake what it
+ * may delete or redefine. nor may it overtake a device-wide delProperty
+ * parked there for the same reason, which would then delete it.
+ */
+static Lane
+ctlLane (ClInfo *cp, unsigned dh, unsigned ph, int alldev)
+{
+    FQ *q = cp->msgq[LANE_BULK];
+    int i, n = nFQ(q);
+
+    for (i = 0; i < n; i++) {
+        Msg *mp = (Msg *) peekiFQ (q, i);
+        if (alldev ? mp->dhash == dh : (mp->phash == ph || mp->phash == dh))
+            return (LANE_BULK);
+    }
+    return (LANE_CTL);
+}
+
+/* queue Msg mp for the given driver */
+static void
+pushDriverMsg (DvrInfo *dp, Msg *mp)
+{
+#ifdef USE_EPOLL
+    /* same as pushClientMsg() */
+    if (nFQ(dp->msgq) == 0) {
+        if (dp->pid == REMOTEDVR)
+            epollCtl (EPOLL_CTL_MOD, dp->wfd, CLEVENTS, EV_DVR, dp - dvrinfo);
+        else
+            epollCtl (EPOLL_CTL_MOD, dp->wfd, EPOLLOUT|EPOLLET, EV_DVRW,
+                                                            dp - dvrinfo);
+    }
+#endif
+    mp->count++;
+    dp->qbytes += mp->cl;
+    pushFQ (dp->msgq, mp);
+}
+
 int isDeviceInDriver(const char *dev, DvrInfo *dp)
 {
+    Route *rp = findRoute (dev, "", 0);
     int i=0;
-    for (i=0; i <dp->ndev; i++)
+
+    if (!rp)
+        return 0;
+    for (i=0; i < rp->nown; i++)
     {
-        if (!strcmp(dev, dp->dev[i]))
+        if (rp->own[i].slot == dp - dvrinfo)
             return 1;
     }
 
@@ -870,6 +1411,12 @@ static void newFIFO(void)
      if (verbose)
             fprintf(stderr, "FIFO: %s\n", line);
 
+     if (!strcmp(line, "stats"))
+     {
+         logStats();
+         continue;
+     }
+
      char cmd[MAXSBUF], arg[4][1], var[4][MAXSBUF], tDriver[MAXSBUF], tName[MAXSBUF], envDev[MAXSBUF], envConfig[MAXSBUF], envSkel[MAXSBUF], envPrefix[MAXSBUF];
 
      memset(&tDriver[0], 0, sizeof(MAXSBUF));
@@ -995,12 +1542,10 @@ static void newFIFO(void)
                 addXMLAtt(root, "device", dp->dev[i]);
 
                 prXMLEle(stderr, root, 0);
-                Msg * mp = newMsg();
+                Msg * mp = newMsgXMLEle(root);
 
                 q2Clients(NULL, 0, dp->dev[i], NULL, mp, root);
-               if (mp->count > 0)
-                   setMsgXMLEle (mp, root);
-               else
+               if (mp->count == 0)
                    freeMsg (mp);
               delXMLEle (root);
             }
@@ -1020,14 +1565,14 @@ static void
 newClient()
 {
     ClInfo *cp = NULL;
-    int s, cli;
+    int s, cli, i;
 
     /* assign new socket */
     s = newClSocket ();
 
     /* try to reuse a clinfo slot, else add one */
     for (cli = 0; cli < nclinfo; cli++)
-        if (!(cp = &clinfo[cli])->active)
+        if (!(cp = &clinfo[cli])->active && !cp->wbusy)
         break;
     if (cli == nclinfo) {
         /* grow clinfo */
@@ -1044,9 +1589,15 @@ newClient()
     cp->active = 1;
     cp->s = s;
     cp->lp = newLilXML();
-    cp->msgq = newFQ(1);
+    arenaLilXML (cp->lp, 1);
+    for (i = 0; i < NLANES; i++)
+        cp->msgq[i] = newFQ(1);
     cp->props = malloc (1);
     cp->nsent = 0;
+    cp->qbytes = 0;
+#ifdef USE_EPOLL
+    watchClient (cp);
+#endif
 
     if (verbose > 0) {
         struct sockaddr_in addr;
@@ -1065,8 +1616,8 @@ newClient()
 #endif
 }
 
-/* read more from the given client, send to each appropriate driver when see
- * xml closure. also send all newXXX() to all other interested clients.
+/* read all available from the given client, send to each appropriate driver
+ * when see xml closure. also send all newXXX() to all other interested clients.
  * return -1 if had to shut down anything, else 0.
  */
 static int
@@ -1074,25 +1625,63 @@ readFromClient (ClInfo *cp)
 {
     char buf[MAXRBUF];
     int shutany = 0;
-    ssize_t i, nr;
+    ssize_t nr;
+
+    /* read client until drained, a short read means we got it all */
+    do {
+        nr = read (cp->s, buf, sizeof(buf));
+        if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (nr <= 0) {
+            if (nr < 0)
+            fprintf (stderr, "%s: Client %d: read: %s\n", indi_tstamp(NULL),
+                                cp->s, strerror(errno));
+            else if (verbose > 0)
+            fprintf (stderr, "%s: Client %d: read EOF\n", indi_tstamp(NULL),
+                                        cp->s);
+            shutdownClient (cp);
+            return (-1);
+        }
 
-    /* read client */
-    nr = read (cp->s, buf, sizeof(buf));
-    if (nr <= 0) {
-        if (nr < 0)
-        fprintf (stderr, "%s: Client %d: read: %s\n", indi_tstamp(NULL),
-                            cp->s, strerror(errno));
-        else if (verbose > 0)
-        fprintf (stderr, "%s: Client %d: read EOF\n", indi_tstamp(NULL),
-                                    cp->s);
-        shutdownClient (cp);
-        return (-1);
-    }
+        switch (clientXML (cp, buf, nr)) {
+        case -1:
+            return (-1);
+        case 1:
+            shutany++;
+            break;
+        }
+    } while (nr == sizeof(buf));
+
+    return (shutany ? -1 : 0);
+}
+
+/* process nr bytes of XML in buf from the given client, sending when find
+ * closure.
+ * return -1 if had to shut down cp, 1 if had to shut down any other, else 0.
+ */
+static int
+clientXML (ClInfo *cp, char buf[], ssize_t nr)
+{
+    int shutany = 0;
+    int n, done;
 
-    /* process XML, sending when find closure */
-    for (i = 0; i < nr; i++) {
+    /* frame XML, sending when find closure */
+    while (nr > 0) {
         char err[1024];
-        XMLEle *root = readXMLEle (cp->lp, buf[i], err);
+        XMLEle *root;
+
+        n = frameXML (&cp->xf, buf, nr, &done, err);
+        if (n < 0) {
+            fprintf (stderr, "%s: Client %d: %s\n", indi_tstamp(NULL),
+                                                        cp->s, err);
+            shutdownClient (cp);
+            return (-1);
+        }
+        buf += n;
+        nr -= n;
+        if (!done)
+            continue;
+        root = parseFrame (cp->lp, &cp->xf, fullFrame (&cp->xf), err);
         if (root) {
         char *roottag = tagXMLEle(root);
         const char *dev = findXMLAttValu (root, "device");
@@ -1110,22 +1699,45 @@ readFromClient (ClInfo *cp)
                     findXMLAttValu (root, "name"));
         }
 
+        /* enableConflate is for us alone */
+        if (!strcmp (roottag, "enableConflate")) {
+            crackConflate (pcdataXMLEle(root), cp);
+            delXMLEle (root);
+            continue;
+        }
+
         /* snag interested properties.
          * N.B. don't open to alldevs if seen specific dev already, else
          *   remote client connections start returning too much.
          */
         if (dev[0])
                     addClDevice (cp, dev, name, isblob);
-        else if (!strcmp (roottag, "getProperties") && !cp->nprops)
+        else if (!strcmp (roottag, "getProperties") && !cp->nprops
+                                                        && !cp->allprops) {
             cp->allprops = 1;
+            allcl = (int *) realloc (allcl, (nallcl+1)*sizeof(int));
+            allcl[nallcl++] = cp - clinfo;
+        }
 
         /* snag enableBLOB -- send to remote drivers too */
         if (!strcmp (roottag, "enableBLOB"))
                    // crackBLOB (pcdataXMLEle(root), &cp->blob);
                      crackBLOBHandling (dev, name, pcdataXMLEle(root), cp);
 
-        /* build a new message -- set content iff anyone cares */
-        mp = newMsg();
+        /* snag whether client reads, and so may also send, binary BLOBs */
+        if (!strcmp (roottag, "getProperties")
+                    && !strcmp (findXMLAttValu (root, "binaryBLOB"), "On"))
+            cp->binblob = cp->xf.rawok = 1;
+
+        /* build a new message, content first so queues can count it.
+         * binaryBLOB is between this client and us alone, our drivers and
+         * chained servers were told ours by our own getProperties.
+         */
+        if (!strcmp (roottag, "getProperties") && findXMLAtt (root, "binaryBLOB")) {
+            rmXMLAtt (root, "binaryBLOB");
+            mp = newMsgXMLEle (root);
+        } else
+            mp = newMsgFrame (&cp->xf);
 
         /* send message to driver(s) responsible for dev */
         q2RDrivers (dev, mp, root);
@@ -1143,11 +1755,8 @@ readFromClient (ClInfo *cp)
             shutany++;
         }
 
-        /* set message content if anyone cares else forget it */
-        if (mp->count > 0)
-            setMsgXMLEle (mp, root);
-        else
-            freeMsg (mp);
+        /* forget message if no one cares */
+        doneMsg (mp);
         delXMLEle (root);
 
         } else if (err[0]) {
@@ -1155,17 +1764,18 @@ readFromClient (ClInfo *cp)
         fprintf (stderr, "%s: Client %d: XML error: %s\n", ts,
                                 cp->s, err);
         fprintf (stderr, "%s: Client %d: XML read: %.*s\n", ts,
-                                cp->s, (int)nr, buf);
+                                cp->s, cp->xf.nbuf < MAXRBUF ? (int)cp->xf.nbuf
+                                : MAXRBUF, cp->xf.buf);
         shutdownClient (cp);
         return (-1);
         }
     }
 
-    return (shutany ? -1 : 0);
+    return (shutany ? 1 : 0);
 }
 
-/* read more from the given driver, send to each interested client when see
- * xml closure. if driver dies, try restarting.
+/* read all available from the given driver, send to each interested client
+ * when see xml closure. if driver dies, try restarting.
  * return 0 if ok else -1 if had to shut down anything.
  */
 static int
@@ -1173,26 +1783,64 @@ readFromDriver (DvrInfo *dp)
 {
     char buf[MAXRBUF];
     int shutany = 0;
-    ssize_t i, nr;
+    ssize_t nr;
+
+    /* read driver until drained, a short read means we got it all */
+    do {
+        nr = read (dp->rfd, buf, sizeof(buf));
+        if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (nr <= 0) {
+            if (nr < 0)
+            fprintf (stderr, "%s: Driver %s: stdin %s\n", indi_tstamp(NULL),
+                                dp->name, strerror(errno));
+            else
+            fprintf (stderr, "%s: Driver %s: stdin EOF\n",
+                                indi_tstamp(NULL), dp->name);
+                shutdownDvr (dp, 1);
+            return (-1);
+        }
 
-    /* read driver */
-    nr = read (dp->rfd, buf, sizeof(buf));
-    if (nr <= 0) {
-        if (nr < 0)
-        fprintf (stderr, "%s: Driver %s: stdin %s\n", indi_tstamp(NULL),
-                            dp->name, strerror(errno));
-        else
-        fprintf (stderr, "%s: Driver %s: stdin EOF\n",
-                            indi_tstamp(NULL), dp->name);
-            shutdownDvr (dp, 1);
-        return (-1);
-    }
+        switch (driverXML (dp, buf, nr)) {
+        case -1:
+            return (-1);
+        case 1:
+            shutany++;
+            break;
+        }
+    } while (nr == sizeof(buf));
+
+    return (shutany ? -1 : 0);
+}
+
+/* process nr bytes of XML in buf from the given driver, sending when find
+ * closure.
+ * return -1 if had to restart dp, 1 if had to shut down any client, else 0.
+ */
+static int
+driverXML (DvrInfo *dp, char buf[], ssize_t nr)
+{
+    int shutany = 0;
+    int n, done;
 
-    /* process XML, sending when find closure */
-    for (i = 0; i < nr; i++)
+    /* frame XML, sending when find closure */
+    while (nr > 0)
     {
         char err[1024];
-        XMLEle *root = readXMLEle (dp->lp, buf[i], err);
+        XMLEle *root;
+
+        n = frameXML (&dp->xf, buf, nr, &done, err);
+        if (n < 0) {
+            fprintf (stderr, "%s: Driver %s: %s\n", indi_tstamp(NULL),
+                                                        dp->name, err);
+            shutdownDvr (dp, 1);
+            return (-1);
+        }
+        buf += n;
+        nr -= n;
+        if (!done)
+            continue;
+        root = parseFrame (dp->lp, &dp->xf, fullFrame (&dp->xf), err);
         if (root)
         {
         char *roottag = tagXMLEle(root);
@@ -1218,13 +1866,16 @@ readFromDriver (DvrInfo *dp)
         if (!strcmp (roottag, "getProperties"))
         {
             addSDevice (dp, dev, name);
-            mp = newMsg();
+            /* binaryBLOB, if any, is the driver's, not ours to pass on */
+            if (findXMLAtt (root, "binaryBLOB")) {
+                rmXMLAtt (root, "binaryBLOB");
+                mp = newMsgXMLEle (root);
+            } else
+                mp = newMsgFrame (&dp->xf);
             /* send to interested chained servers upstream */
             if (q2Servers(NULL, mp, root) < 0)
                 shutany++;
-            if (mp->count > 0)
-                setMsgXMLEle (mp, root);
-            else
+            if (mp->count == 0)
                 freeMsg (mp);
             delXMLEle (root);
             continue;
@@ -1249,6 +1900,7 @@ readFromDriver (DvrInfo *dp)
 
             strncpy (dp->dev[dp->ndev], dev, MAXINDIDEVICE-1);
             dp->dev[dp->ndev][MAXINDIDEVICE-1] = '\0';
+            routeDvrDevice (dp, dp->dev[dp->ndev]);
 
 #ifdef OSX_EMBEDED_MODE
             if (!dp->ndev)
@@ -1262,8 +1914,8 @@ readFromDriver (DvrInfo *dp)
         if (ldir)
             logDMsg (root, dev);
 
-        /* build a new message -- set content iff anyone cares */
-        mp = newMsg();
+        /* build a new message, content first so queues can count it */
+        mp = newMsgFrame (&dp->xf);
 
         /* send to interested clients */
          if (q2Clients (NULL, isblob, dev, name, mp, root) < 0)
@@ -1272,11 +1924,8 @@ readFromDriver (DvrInfo *dp)
         /* send to snooping drivers */
         q2SDrivers (isblob, dev, name, mp, root);
 
-        /* set message content if anyone cares else forget it */
-        if (mp->count > 0)
-            setMsgXMLEle (mp, root);
-        else
-            freeMsg (mp);
+        /* forget message if no one cares */
+        doneMsg (mp);
         delXMLEle (root);
 
         } else if (err[0]) {
@@ -1284,16 +1933,18 @@ readFromDriver (DvrInfo *dp)
         fprintf (stderr, "%s: Driver %s: XML error: %s\n", ts,
                                 dp->name, err);
         fprintf (stderr, "%s: Driver %s: XML read: %.*s\n", ts,
-                                dp->name, (int)nr, buf);
+                                dp->name, dp->xf.nbuf < MAXRBUF ? (int)dp->xf.nbuf
+                                : MAXRBUF, dp->xf.buf);
                 shutdownDvr (dp, 1);
         return (-1);
         }
     }
 
-    return (shutany ? -1 : 0);
+    return (shutany ? 1 : 0);
 }
 
-/* read more from the given driver stderr, add prefix and send to our stderr.
+/* read all available from the given driver stderr, add prefix and send to
+ * our stderr.
  * return 0 if ok else -1 if had to restart.
  */
 static int
@@ -1303,8 +1954,19 @@ stderrFromDriver (DvrInfo *dp)
     static int nexbuf;
     ssize_t i, nr;
 
+    /* until drained */
+    for (;;) {
+    /* a line that fills exbuf is sent as is */
+    if (nexbuf == sizeof(exbuf)) {
+        fprintf (stderr, "%s: Driver %s: %.*s\n", indi_tstamp(NULL),
+                                dp->name, nexbuf, exbuf);
+        nexbuf = 0;
+    }
+
     /* read more */
     nr = read (dp->efd, exbuf+nexbuf, sizeof(exbuf)-nexbuf);
+    if (nr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
     if (nr <= 0) {
         if (nr < 0)
         fprintf (stderr, "%s: Driver %s: stderr %s\n", indi_tstamp(NULL),
@@ -1328,52 +1990,332 @@ stderrFromDriver (DvrInfo *dp)
         i = -1;				  /* restart for loop scan */
         }
     }
+    }
 
     return (0);
 }
 
-/* close down the given client */
-static void
-shutdownClient (ClInfo *cp)
+/* scan up to nr more bytes of buf for the end of the current root element,
+ * appending the bytes that belong to it to xf->buf. content, including all
+ * of any BLOB, is skipped with memchr; only markup is examined by char.
+ * binary BLOBs attached to a setBLOBVector are appended after it, the element
+ * itself is the first xf->xmllen bytes then.
+ * return number of bytes of buf used and set *done if xf->buf now holds a
+ * complete element, which stays there until the next call, else -1 with
+ * reason in err[] if the peer can not be framed any further.
+ */
+static int
+frameXML (XMLFrame *xf, const char buf[], int nr, int *done, char err[])
 {
-    Msg *mp;
+    int from, i, n, closed = 0;
 
-    /* close connection */
-    shutdown (cp->s, SHUT_RDWR);
-    close (cp->s);
+    /* forget the element we returned last time */
+    if (xf->complete)
+        doneFrame (xf);
 
-    /* free memory */
-    delLilXML (cp->lp);
-    free (cp->props);
+    /* still collecting attached BLOB bytes? */
+    if (xf->rawleft > 0)
+        return (frameRaw (xf, buf, nr, done, err));
 
-    /* decrement and possibly free any unsent messages for this client */
-    while ((mp = (Msg*) popFQ(cp->msgq)) != NULL)
-        if (--mp->count == 0)
-        freeMsg (mp);
-    delFQ (cp->msgq);
+    /* keep bytes from the start if already inside an element */
+    from = (xf->depth > 0 || xf->intag) ? 0 : -1;
 
-    /* ok now to recycle */
-    cp->active = 0;
+    *done = 0;
+    for (i = 0; i < nr; ) {
+        int c;
 
-    if (verbose > 0)
-        fprintf (stderr, "%s: Client %d: shut down complete - bye!\n",
-                            indi_tstamp(NULL), cp->s);
-#ifdef OSX_EMBEDED_MODE
-  int active = 0;
-  for (int i = 0; i < nclinfo; i++)
-    if (clinfo[i].active)
-      active++;
-  fprintf(stderr, "CLIENTS %d\n", active); fflush(stderr);
-#endif
-}
+        if (!xf->intag) {
+            /* skip content to next tag */
+            const char *lt = (const char *) memchr (buf+i, '<', nr-i);
+            if (!lt) {
+                i = nr;
+                break;
+            }
+            if (from < 0)
+                from = lt - buf;	/* new root, drop junk before it */
+            xf->tagstart = xf->nbuf + (lt - buf) - from;
+            i = lt - buf + 1;
+            xf->intag = 1;
+            xf->kind = 0;
+            continue;
+        }
 
-/* close down the given driver and restart */
+        c = buf[i++];
+        if (xf->kind == 0) {
+            /* first char tells end tag, comment/declaration or element */
+            xf->kind = (c == '/' || c == '!' || c == '?') ? c : '<';
+        } else if (xf->quote) {
+            if (c == xf->quote)
+                xf->quote = 0;
+        } else if (xf->kind == '<' && (c == '\'' || c == '"')) {
+            xf->quote = c;
+        } else if (c == '>') {
+            xf->intag = 0;
+            if (xf->kind == '<' && xf->depth == 0)
+                xf->headlen = xf->nbuf + i - from;
+            if (xf->kind == '/')
+                xf->depth--;
+            else if (xf->kind == '<' && xf->lastc != '/')
+                xf->depth++;
+            else if (xf->kind == '<' && xf->depth == 1) {
+                /* empty child of root, may announce attached BLOB bytes */
+                long na;
+                if (growFrame (xf, buf+from, i-from, err) < 0)
+                    return (-1);
+                from = i;
+                na = attachedFrame (xf);
+                if (na < 0 || (na > 0 && !xf->rawok)
+                        || (size_t)na > MAXELEMENT - xf->nbuf - xf->attached) {
+                    sprintf (err, "%s attached BLOB length",
+                                        xf->rawok ? "bad" : "unexpected");
+                    return (-1);
+                }
+                xf->attached += na;
+            }
+
+            /* closed root, or root was an empty element */
+            if (xf->depth == 0 && (xf->kind == '/' || xf->kind == '<')) {
+                closed = 1;
+                break;
+            }
+            if (xf->depth <= 0) {
+                /* top level comment or stray end tag, drop it */
+                xf->depth = 0;
+                xf->nbuf = 0;
+                from = -1;
+            }
+        }
+        xf->lastc = c;
+    }
+
+    /* save our part */
+    if (from >= 0 && growFrame (xf, buf+from, i-from, err) < 0)
+        return (-1);
+
+    /* the attached BLOB bytes follow the end tag */
+    if (closed && xf->attached > 0) {
+        xf->xmllen = xf->nbuf;
+        xf->rawleft = xf->attached;
+        n = frameRaw (xf, buf+i, nr-i, done, err);
+        return (n < 0 ? -1 : i + n);
+    }
+
+    if (closed) {
+        xf->complete = 1;
+        *done = 1;
+    }
+
+    return (i);
+}
+
+/* append up to xf->rawleft bytes of buf to xf->buf as attached BLOB data.
+ * return number of bytes of buf used and set *done if that was the last,
+ * else -1 with reason in err[].
+ */
+static int
+frameRaw (XMLFrame *xf, const char buf[], int nr, int *done, char err[])
+{
+    int n = nr < xf->rawleft ? nr : (int)xf->rawleft;
+
+    if (growFrame (xf, buf, n, err) < 0)
+        return (-1);
+    xf->rawleft -= n;
+    *done = 0;
+    if (xf->rawleft == 0) {
+        xf->complete = 1;
+        *done = 1;
+    }
+
+    return (n);
+}
+
+/* return the attached byte count of the empty tag just framed at
+ * xf->tagstart if it is a oneBLOB of a setBLOBVector, 0 if not, or -1 if
+ * the count is not a number.
+ */
+static long
+attachedFrame (XMLFrame *xf)
+{
+    const char *tag = xf->buf + xf->tagstart;
+    const char *ap;
+    char *end;
+    long n;
+
+    if (strncmp (xf->buf, "<setBLOBVector", 14) || strncmp (tag, "<oneBLOB", 8))
+        return (0);
+    ap = strstr (tag, "attached=");
+    if (!ap || (ap[9] != '\'' && ap[9] != '"'))
+        return (0);
+    errno = 0;
+    n = strtol (ap + 10, &end, 10);
+    if (end == ap + 10 || *end != ap[9] || errno || n < 0)
+        return (-1);
+    return (n);
+}
+
+/* append n bytes at s to xf->buf, keeping it \0 terminated with room for a
+ * newline more, see newMsgFrame().
+ * return 0 if ok, else -1 with reason in err[] if the element would be too
+ * large or there is no memory for it.
+ */
+static int
+growFrame (XMLFrame *xf, const char *s, int n, char err[])
+{
+    size_t need = xf->nbuf + n + 2;
+
+    if (need > MAXELEMENT) {
+        sprintf (err, "XML element larger than %d bytes", MAXELEMENT);
+        return (-1);
+    }
+    if (need > xf->mbuf) {
+        size_t m = xf->mbuf ? xf->mbuf : MAXRBUF;
+        char *nb;
+        while (need > m)
+            m *= 2;
+        nb = (char *) realloc (xf->buf, m);
+        if (!nb) {
+            sprintf (err, "no memory for %lu byte XML element",
+                                                    (unsigned long)m);
+            return (-1);
+        }
+        xf->buf = nb;
+        xf->mbuf = m;
+    }
+    memcpy (xf->buf + xf->nbuf, s, n);
+    xf->nbuf += n;
+    xf->buf[xf->nbuf] = '\0';
+    return (0);
+}
+
+/* start framing a fresh element, reusing buf unless it grew large */
+static void
+doneFrame (XMLFrame *xf)
+{
+    if (xf->mbuf > MAXFRAME) {
+        free (xf->buf);
+        xf->buf = NULL;
+        xf->mbuf = 0;
+    }
+    xf->nbuf = 0;
+    xf->depth = 0;
+    xf->intag = 0;
+    xf->kind = 0;
+    xf->quote = 0;
+    xf->lastc = 0;
+    xf->headlen = 0;
+    xf->tagstart = 0;
+    xf->attached = 0;
+    xf->rawleft = 0;
+    xf->xmllen = 0;
+    xf->complete = 0;
+}
+
+/* release all memory of xf and reset for a new connection */
+static void
+freeFrame (XMLFrame *xf)
+{
+    free (xf->buf);
+    memset (xf, 0, sizeof(*xf));
+}
+
+/* return 1 if the whole element framed in xf must be parsed, else 0 if its
+ * start tag is all we need for routing. enableBLOB and enableConflate need
+ * their pcdata, textMsg() needs the oneBLOBs of binary BLOBs and tracing
+ * prints everything.
+ */
+static int
+fullFrame (XMLFrame *xf)
+{
+    return (verbose > 2 || xf->xmllen > 0 || !strncmp (xf->buf, "<enable", 7));
+}
+
+/* parse the complete element framed in xf into a new tree.
+ * unless full, only the start tag is parsed, as an empty element.
+ * return root else NULL with reason in err[].
+ */
+static XMLEle *
+parseFrame (LilXML *lp, XMLFrame *xf, int full, char err[])
+{
+    int len = xf->xmllen > 0 ? xf->xmllen : (int)xf->nbuf;
+    XMLEle *root;
+    int used;
+
+    /* just the start tag? feed it as <tag attrs/> */
+    if (!full) {
+        char *gt = xf->buf + xf->headlen - 1;
+
+        root = readXMLChunk (lp, xf->buf, xf->headlen - 1, &used, err);
+        if (!root && !err[0] && gt[-1] != '/')
+            root = readXMLEle (lp, '/', err);
+        if (!root && !err[0])
+            root = readXMLEle (lp, '>', err);
+        if (!root && !err[0])
+            sprintf (err, "incomplete start tag");
+        return (root);
+    }
+
+    root = readXMLChunk (lp, xf->buf, len, &used, err);
+    if (!root && !err[0])
+        sprintf (err, "incomplete element");
+
+    return (root);
+}
+
+/* close down the given client */
+static void
+shutdownClient (ClInfo *cp)
+{
+    Msg *mp;
+    int i;
+
+    /* close connection */
+#ifdef USE_EPOLL
+    epoll_ctl (epfd, EPOLL_CTL_DEL, cp->s, NULL);
+#endif
+    shutdown (cp->s, SHUT_RDWR);
+    if (!cp->wbusy)
+        close (cp->s);	/* else writersDone() will, and free the slot */
+
+    /* free memory */
+    delLilXML (cp->lp);
+    freeFrame (&cp->xf);
+    unrouteClient (cp);
+    free (cp->props);
+    free (cp->conf);
+
+    /* decrement and possibly free any unsent messages for this client */
+    for (i = 0; i < NLANES; i++) {
+        while ((mp = (Msg*) popFQ(cp->msgq[i])) != NULL)
+            if (--mp->count == 0)
+            freeMsg (mp);
+        delFQ (cp->msgq[i]);
+    }
+
+    /* ok now to recycle */
+    cp->active = 0;
+
+    if (verbose > 0)
+        fprintf (stderr, "%s: Client %d: shut down complete - bye!\n",
+                            indi_tstamp(NULL), cp->s);
+#ifdef OSX_EMBEDED_MODE
+  int active = 0;
+  for (int i = 0; i < nclinfo; i++)
+    if (clinfo[i].active)
+      active++;
+  fprintf(stderr, "CLIENTS %d\n", active); fflush(stderr);
+#endif
+}
+
+/* close down the given driver and restart */
 static void
 shutdownDvr (DvrInfo *dp, int restart)
 {
     Msg *mp;
 
     /* make sure it's dead, reclaim resources */
+#ifdef USE_EPOLL
+    unwatchDvr (dp);
+#endif
     if (dp->pid == REMOTEDVR) {
         /* socket connection */
         shutdown (dp->wfd, SHUT_RDWR);
@@ -1391,9 +2333,11 @@ shutdownDvr (DvrInfo *dp, int restart)
 #endif
 
     /* free memory */
+    unrouteDvr (dp);
     free (dp->sprops);
     free(dp->dev);
     delLilXML (dp->lp);
+    freeFrame (&dp->xf);
 
    /* ok now to recycle */
    dp->active = 0;
@@ -1431,6 +2375,26 @@ q2RDrivers (const char *dev, Msg *mp, XMLEle *root)
 {
     int sawremote = 0;
     DvrInfo *dp;
+    Route *rp;
+    int i;
+
+    /* a known dev goes only to the drivers that serve it */
+    if (dev[0]) {
+        if (!(rp = findRoute (dev, "", 0)))
+            return;
+        for (i = 0; i < rp->nown; i++) {
+            dp = &dvrinfo[rp->own[i].slot];
+            if (dp->active == 0)
+                continue;
+            pushDriverMsg (dp, textMsg (mp, root));
+            if (verbose > 1)
+            fprintf (stderr, "%s: Driver %s: queuing responsible for <%s device='%s' name='%s'>\n",
+                    indi_tstamp(NULL), dp->name, tagXMLEle(root),
+                    findXMLAttValu (root, "device"),
+                    findXMLAttValu (root, "name"));
+        }
+        return;
+    }
 
     /* queue message to each interested driver.
      * N.B. don't send generic getProps to more than one remote driver,
@@ -1440,17 +2404,13 @@ q2RDrivers (const char *dev, Msg *mp, XMLEle *root)
         int isremote = (dp->pid == REMOTEDVR);
             if (dp->active == 0)
                 continue;
-        //if (dev[0] && dp->dev[0] && strcmp (dev, dp->dev))
-            if (dev[0] && isDeviceInDriver(dev, dp) == 0)
-                continue;	/* driver known to not support this dev */
         if (!dev[0] && isremote && sawremote)
         continue;	/* already sent generic to another remote */
         if (isremote)
         sawremote = 1;
 
         /* ok: queue message to this driver */
-        mp->count++;
-        pushFQ (dp->msgq, mp);
+        pushDriverMsg (dp, textMsg (mp, root));
         if (verbose > 1)
         fprintf (stderr, "%s: Driver %s: queuing responsible for <%s device='%s' name='%s'>\n",
                     indi_tstamp(NULL), dp->name, tagXMLEle(root),
@@ -1465,26 +2425,51 @@ q2RDrivers (const char *dev, Msg *mp, XMLEle *root)
 static void
 q2SDrivers (int isblob, const char *dev, const char *name, Msg *mp, XMLEle *root)
 {
+    Route *rps[2];
     DvrInfo *dp;
+    int i, j;
 
-    for (dp = dvrinfo; dp < &dvrinfo[ndvrinfo]; dp++) {
-            Property *sp = findSDevice (dp, dev, name);
+    /* mark each driver snooping dev/name or all of dev. like findSDevice(),
+     * a driver snooping both uses the one it asked for first.
+     */
+    routeseq++;
+    rps[0] = findRoute (dev, name, 0);
+    rps[1] = name[0] ? findRoute (dev, "", 0) : NULL;
+    for (j = 0; j < 2; j++) {
+        for (i = 0; rps[j] && i < rps[j]->nsd; i++) {
+            Sub *sb = &rps[j]->sd[i];
+            dp = &dvrinfo[sb->slot];
+            if (dp->rseq != routeseq || sb->prop < dp->rprop) {
+                dp->rseq = routeseq;
+                dp->rprop = sb->prop;
+            }
+        }
+    }
 
-        /* nothing for dp if not snooping for dev/name or wrong BLOB mode */
-        if (!sp)
-        continue;
+    /* visit each marked driver once, clearing rprop as we go */
+    for (j = 0; j < 2; j++) {
+        for (i = 0; rps[j] && i < rps[j]->nsd; i++) {
+            Property *sp;
+
+            dp = &dvrinfo[rps[j]->sd[i].slot];
+            if (dp->active == 0 || dp->rprop < 0)
+                continue;
+            sp = &dp->sprops[dp->rprop];
+            dp->rprop = -1;
+
+        /* nothing for dp if wrong BLOB mode */
         if ((isblob && sp->blob==B_NEVER) || (!isblob && sp->blob==B_ONLY))
         continue;
 
-        /* ok: queue message to this device */
-        mp->count++;
-        pushFQ (dp->msgq, mp);
+        /* ok: queue message to this device, drivers only read base64 */
+        pushDriverMsg (dp, textMsg (mp, root));
         if (verbose > 1) {
         fprintf (stderr, "%s: Driver %s: queuing snooped <%s device='%s' name='%s'>\n",
                     indi_tstamp(NULL), dp->name, tagXMLEle(root),
                     findXMLAttValu (root, "device"),
                     findXMLAttValu (root, "name"));
         }
+        }
     }
 }
 
@@ -1495,6 +2480,7 @@ static void
 addSDevice (DvrInfo *dp, const char *dev, const char *name)
 {
         Property *sp;
+    Route *rp;
     char *ip;
 
     /* no dups */
@@ -1517,6 +2503,9 @@ addSDevice (DvrInfo *dp, const char *dev, const char *name)
 
     sp->blob = B_NEVER;
 
+    rp = findRoute (sp->dev, sp->name, 1);
+    addSub (&rp->sd, &rp->nsd, dp - dvrinfo, dp->nsprops-1);
+
     if (verbose)
         fprintf (stderr, "%s: Driver %s: snooping on %s.%s\n", indi_tstamp(NULL),
                             dp->name, dev, name);
@@ -1549,57 +2538,54 @@ q2Clients (ClInfo *notme, int isblob, const char *dev, const char *name, Msg *mp
 {
     int shutany = 0;
     ClInfo *cp;
-    int ql,i=0;
+    Msg *qmp;
+    Lane lane;
+    unsigned dh, ph;
+    int alldev;
+    int i, n;
+
+    if (!name)
+        name = "";
+
+    /* what a queued BLOB is for, and what this may not overtake */
+    dh = routeHash (dev, "");
+    ph = routeHash (dev, name);
+    alldev = !name[0] && !strcmp (tagXMLEle(root), "delProperty");
 
     /* queue message to each interested client */
-    for (cp = clinfo; cp < &clinfo[nclinfo]; cp++) {
-        /* cp in use? notme? want this dev/name? blob? */
-        if (!cp->active || cp == notme)
-        continue;
-            if (findClDevice (cp, dev, name) < 0)
-        continue;
+    n = routeClients (notme, dev, name);
+    for (i = 0; i < n; i++) {
+        cp = &clinfo[clroute[i]];
 
             //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
             if (!isblob && cp->blob==B_ONLY)
                 continue;
 
+            /* a BLOB mode for this very property overrides the client's */
             if (isblob)
             {
-                if (cp->nprops > 0)
-                {
-                Property *pp = NULL;
-                int blob_found=0;
-                for (i = 0; i < cp->nprops; i++)
-                {
-                    pp = &cp->props[i];
-                    if (!strcmp (pp->dev, dev) && (!strcmp(pp->name, name)))
-                    {
-                        blob_found = 1;
-                        break;
-                    }
-                }
-
-                if ( (blob_found && pp->blob == B_NEVER) || (blob_found==0 && cp->blob == B_NEVER) )
+                if (cp->rprop >= 0 ? cp->props[cp->rprop].blob == B_NEVER
+                                   : cp->blob == B_NEVER)
                     continue;
-               }
-               else if (cp->blob == B_NEVER)
-                   continue;
-           }
+            }
 
         /* shut down this client if its q is already too large */
-        ql = msgQSize(cp->msgq);
-        if (ql > maxqsiz) {
+        if (cp->qbytes > (unsigned long)maxqsiz) {
         if (verbose)
-            fprintf (stderr, "%s: Client %d: %d bytes behind, shutting down\n",
-                            indi_tstamp(NULL), cp->s, ql);
+            fprintf (stderr, "%s: Client %d: %lu bytes behind, shutting down\n",
+                            indi_tstamp(NULL), cp->s, cp->qbytes);
         shutdownClient (cp);
         shutany++;
         continue;
         }
 
-        /* ok: queue message to this client */
-        mp->count++;
-        pushFQ (cp->msgq, mp);
+        /* ok: queue message to this client, or update one still queued */
+        qmp = cp->binblob ? mp : textMsg (mp, root);
+        qmp->dhash = dh;
+        qmp->phash = ph;
+        lane = isblob ? LANE_BULK : ctlLane (cp, dh, ph, alldev);
+        if (!cp->conflate || !conflateClientMsg (cp, qmp, root, lane))
+            pushClientMsg (cp, qmp, lane);
         if (verbose > 1)
         fprintf (stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n",
                     indi_tstamp(NULL), cp->s, tagXMLEle(root),
@@ -1618,7 +2604,6 @@ q2Servers (ClInfo *notme, Msg *mp, XMLEle *root)
 {
     int shutany = 0;
     ClInfo *cp;
-    int ql=0;
 
     /* queue message to each interested client */
     for (cp = clinfo; cp < &clinfo[nclinfo]; cp++)
@@ -1628,20 +2613,18 @@ q2Servers (ClInfo *notme, Msg *mp, XMLEle *root)
             continue;
 
         /* shut down this client if its q is already too large */
-        ql = msgQSize(cp->msgq);
-        if (ql > maxqsiz)
+        if (cp->qbytes > (unsigned long)maxqsiz)
         {
         if (verbose)
-            fprintf (stderr, "%s: Client %d: %d bytes behind, shutting down\n",
-                            indi_tstamp(NULL), cp->s, ql);
+            fprintf (stderr, "%s: Client %d: %lu bytes behind, shutting down\n",
+                            indi_tstamp(NULL), cp->s, cp->qbytes);
         shutdownClient (cp);
         shutany++;
         continue;
         }
 
         /* ok: queue message to this client */
-        mp->count++;
-        pushFQ (cp->msgq, mp);
+        pushClientMsg (cp, mp, LANE_CTL);
         if (verbose > 1)
         fprintf (stderr, "%s: Client %d: queuing <%s device='%s' name='%s'>\n",
                     indi_tstamp(NULL), cp->s, tagXMLEle(root),
@@ -1652,85 +2635,270 @@ q2Servers (ClInfo *notme, Msg *mp, XMLEle *root)
     return (shutany ? -1 : 0);
 }
 
-/* return size of all Msqs on the given q */
-static int
-msgQSize (FQ *q)
+/* return a new Msg with content printed from root.
+ */
+static Msg *
+newMsgXMLEle (XMLEle *root)
 {
-    int i, l = 0;
+    /* want cl to only count content, but need room for final \0 */
+    Msg *mp = newMsg (sprlXMLEle (root, 0));
+
+    sprXMLEle (mp->cp, root, 0);
+    return (mp);
+}
 
-    for (i = 0; i < nFQ(q); i++) {
-        Msg *mp = (Msg *) peekiFQ(q,i);
-        l += mp->cl;
+/* return a new Msg with the raw element in xf as content, plus a trailing
+ * newline. a large buf is handed over as is, xf gets a fresh one for the next
+ * element.
+ */
+static Msg *
+newMsgFrame (XMLFrame *xf)
+{
+    Msg *mp;
+
+    /* growFrame() left room for it */
+    xf->buf[xf->nbuf++] = '\n';
+    xf->buf[xf->nbuf] = '\0';
+    if (xf->nbuf < MAXWSIZ) {
+        mp = newMsg (xf->nbuf);
+        memcpy (mp->cp, xf->buf, xf->nbuf+1);
+    } else {
+        mp = newMsg (0);
+        mp->cl = xf->nbuf;
+        mp->cp = xf->buf;
+        xf->buf = NULL;
+        xf->mbuf = 0;
+        xf->nbuf = 0;
     }
+    mp->xmllen = xf->xmllen;
 
-    return (l);
+    return (mp);
 }
 
-/* print root as content in Msg mp.
+/* return a version of mp with any binary BLOBs in base64, for a peer that
+ * did not ask for them binary. root is the fully parsed mp, its oneBLOBs are
+ * edited to match. the text Msg is made once and kept in mp->text until
+ * doneMsg(), else mp itself is returned.
  */
+static Msg *
+textMsg (Msg *mp, XMLEle *root)
+{
+    const unsigned char *raw, *end;
+    XMLEle *ep;
+
+    if (!mp->xmllen)
+        return (mp);
+    if (mp->text)
+        return (mp->text);
+
+    raw = (unsigned char *) mp->cp + mp->xmllen;
+    end = (unsigned char *) mp->cp + mp->cl;
+    for (ep = nextXMLEle (root, 1); ep; ep = nextXMLEle (root, 0)) {
+        XMLAtt *ap = findXMLAtt (ep, "attached");
+        char enclen[32];
+        char *b64;
+        long n;
+        int l;
+
+        if (!ap || strcmp (tagXMLEle(ep), "oneBLOB"))
+            continue;
+        n = atol (valuXMLAtt(ap));
+        if (n < 0 || n > end - raw)
+            n = end - raw;
+        b64 = (char *) malloc (4*n/3 + 4);
+        if (!b64) {
+            fprintf (stderr, "%s: no memory for %ld byte BLOB\n",
+                                                indi_tstamp(NULL), 4*n/3 + 4);
+            Bye();
+        }
+        l = to64frombits ((unsigned char *) b64, raw, n);
+        editXMLEle (ep, b64);
+        free (b64);
+        rmXMLAtt (ep, "attached");
+        sprintf (enclen, "%d", l);
+        addXMLAtt (ep, "enclen", enclen);
+        raw += n;
+    }
+
+    mp->text = newMsgXMLEle (root);
+    return (mp->text);
+}
+
+/* done routing mp: free it, and any text version of it, if no one cares */
 static void
-setMsgXMLEle (Msg *mp, XMLEle *root)
+doneMsg (Msg *mp)
 {
-    /* want cl to only count content, but need room for final \0 */
-    mp->cl = sprlXMLEle (root, 0);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
-    else
-        mp->cp = malloc (mp->cl+1);
-    sprXMLEle (mp->cp, root, 0);
+    if (mp->text && mp->text->count == 0)
+        freeMsg (mp->text);
+    mp->text = NULL;
+    if (mp->count == 0)
+        freeMsg (mp);
 }
 
-/* save str as content in Msg mp.
+/* return a new Msg with a copy of str as content.
  */
-static void
-setMsgStr (Msg *mp, char *str)
+static Msg *
+newMsgStr (char *str)
 {
     /* want cl to only count content, but need room for final \0 */
-    mp->cl = strlen (str);
-    if (mp->cl < sizeof(mp->buf))
-        mp->cp = mp->buf;
-    else
-        mp->cp = malloc (mp->cl+1);
+    Msg *mp = newMsg (strlen (str));
+
     strcpy (mp->cp, str);
+    return (mp);
 }
 
-/* return pointer to one new nulled Msg
+/* return a Msg with no consumers and room for cl bytes of content plus \0.
+ * it comes from the pool of the smallest size class whose local buf holds
+ * that, else from the small class with content malloced. a pool miss mallocs
+ * a new one.
  */
 static Msg *
-newMsg (void)
+newMsg (unsigned long cl)
 {
-    return ((Msg *) calloc (1, sizeof(Msg)));
+    int pool = (cl < MSGSMALL || cl >= MAXWSIZ) ? 0 : 1;
+    Msg *mp = msgpool[pool];
+
+    if (mp) {
+        msgpool[pool] = (Msg *) mp->cp;
+        nmsgpool[pool]--;
+        msgpoolhits++;
+    } else {
+        mp = (Msg *) malloc (sizeof(Msg) + msgbufsiz[pool]);
+        if (!mp) {
+            fprintf (stderr, "%s: no memory for new message\n",
+                                                    indi_tstamp(NULL));
+            Bye();
+        }
+        mp->pool = pool;
+        msgpoolmisses++;
+    }
+
+    mp->count = 0;
+    mp->cl = cl;
+    mp->xmllen = 0;
+    mp->text = NULL;
+    if (cl < (unsigned long)msgbufsiz[pool])
+        mp->cp = mp->buf;
+    else if (!(mp->cp = (char *) malloc (cl+1))) {
+        fprintf (stderr, "%s: no memory for %lu byte message\n",
+                                                indi_tstamp(NULL), cl+1);
+        Bye();
+    }
+
+    return (mp);
 }
 
-/* free Msg mp and everything it contains */
+/* free content of Msg mp and return it to its pool, unless that is full */
 static void
 freeMsg (Msg *mp)
 {
     if (mp->cp && mp->cp != mp->buf)
         free (mp->cp);
-    free (mp);
+
+    if (nmsgpool[mp->pool] < MAXMSGPOOL) {
+        mp->cp = (char *) msgpool[mp->pool];
+        msgpool[mp->pool] = mp;
+        nmsgpool[mp->pool]++;
+    } else
+        free (mp);
+}
+
+/* print message pool use and queue depth of each client and driver */
+static void
+logStats (void)
+{
+    char *ts = indi_tstamp(NULL);
+    int i;
+
+    fprintf (stderr, "%s: stats: Msg pool %lu hits %lu misses, %d+%d free\n",
+                    ts, msgpoolhits, msgpoolmisses, nmsgpool[0], nmsgpool[1]);
+    fprintf (stderr, "%s: stats: %d routes in %d buckets\n", ts, nroute,
+                                                                nroutes);
+    for (i = 0; i < nclinfo; i++) {
+        ClInfo *cp = &clinfo[i];
+        if (cp->active)
+            fprintf (stderr, "%s: stats: Client %d: %d+%d msgs %lu bytes queued, %lu conflated\n",
+                                    ts, cp->s, nFQ(cp->msgq[LANE_CTL]),
+                                    nFQ(cp->msgq[LANE_BULK]), cp->qbytes,
+                                    cp->nconflated);
+    }
+    for (i = 0; i < ndvrinfo; i++) {
+        DvrInfo *dp = &dvrinfo[i];
+        if (dp->active)
+            fprintf (stderr, "%s: stats: Driver %s: %d msgs %lu bytes queued\n",
+                                    ts, dp->name, nFQ(dp->msgq), dp->qbytes);
+    }
 }
 
-/* write the next chunk of the current message in the queue to the given
- * client. pop message from queue when complete and free the message if we are
- * the last one to use it. shut down this client if trouble.
- * N.B. we assume we will never be called with cp->msgq empty.
+/* write as much of the messages in the queue to the given client as the
+ * socket will take, gathering several messages per writev(). pop each message
+ * from queue when complete and free the message if we are the last one to use
+ * it. a partly sent message is always finished first, then the control lane
+ * is preferred over the bulk lane. shut down this client if trouble.
  * return 0 if ok else -1 if had to shut down.
  */
 static int
 sendClientMsg (ClInfo *cp)
 {
-    ssize_t nsend, nw;
-    Msg *mp;
+    struct iovec iov[MAXIOV];
+    ssize_t nw;
+    int i, niov;
+    FQ *q;
+
+    /* a write thread has the socket until writersDone() */
+    if (cp->wbusy)
+        return (0);
+
+    while (nClientMsg(cp) > 0) {
+    /* pick a lane at each message boundary */
+    if (cp->nsent == 0)
+        cp->lane = nFQ(cp->msgq[LANE_CTL]) > 0 ? LANE_CTL : LANE_BULK;
+    q = cp->msgq[cp->lane];
 
-    /* get current message */
-    mp = (Msg *) peekFQ (cp->msgq);
+    /* send the unsent part of the current message and those after it.
+     * BLOBs are large enough on their own, taking them one at a time lets
+     * the control lane in after each.
+     */
+    niov = msgQIOV (q, cp->nsent, iov);
+    if (cp->lane == LANE_BULK)
+        niov = 1;
+
+    /* hand a large message to a write thread, stop short of any later one */
+    if (nwthreads > 0) {
+        if (iov[0].iov_len >= wthresh) {
+            WJob *jp = (WJob *) malloc (sizeof(WJob));
+            if (!jp) {
+                fprintf (stderr, "%s: no memory for write job\n",
+                                                    indi_tstamp(NULL));
+                Bye();
+            }
+            jp->slot = cp - clinfo;
+            jp->fd = cp->s;
+            jp->mp = (Msg *) peekFQ (q);
+            jp->mp->count++;
+            jp->off = cp->nsent;
+            jp->err = 0;
+            cp->wbusy = 1;
+            if (verbose > 1)
+                fprintf (stderr, "%s: Client %d: %lu bytes to write thread\n",
+                                    indi_tstamp(NULL), cp->s,
+                                    (unsigned long)iov[0].iov_len);
+            pthread_mutex_lock (&wlock);
+            pushFQ (wtodo, jp);
+            pthread_cond_signal (&wcond);
+            pthread_mutex_unlock (&wlock);
+            break;
+        }
+        for (i = 1; i < niov; i++)
+            if (iov[i].iov_len >= wthresh)
+                niov = i;
+    }
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    nsend = mp->cl - cp->nsent;
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
-    nw = write (cp->s, &mp->cp[cp->nsent], nsend);
+    nw = writev (cp->s, iov, niov);
+
+    /* done for now if socket is full */
+    if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
 
     /* shut down if trouble */
     if (nw <= 0) {
@@ -1746,48 +2914,46 @@ sendClientMsg (ClInfo *cp)
 
     /* trace */
     if (verbose > 2) {
-        fprintf(stderr, "%s: Client %d: sending msg copy %d nq %d:\n%.*s\n",
-                indi_tstamp(NULL), cp->s, mp->count, nFQ(cp->msgq),
-                (int)nw, &mp->cp[cp->nsent]);
+        Msg *mp = (Msg *) peekFQ (q);
+        fprintf(stderr, "%s: Client %d: sending %ld bytes of %d msgs, msg copy %d nq %d:\n%.*s\n",
+                indi_tstamp(NULL), cp->s, (long)nw, niov, mp->count,
+                nClientMsg(cp), (int)((size_t)nw < iov[0].iov_len ? (size_t)nw
+                : iov[0].iov_len), (char *)iov[0].iov_base);
     } else if (verbose > 1) {
         fprintf(stderr, "%s: Client %d: sending %.50s\n", indi_tstamp(NULL),
-                            cp->s, &mp->cp[cp->nsent]);
+                            cp->s, (char *)iov[0].iov_base);
     }
 
-    /* update amount sent. when complete: free message if we are the last
-     * to use it and pop from our queue.
-     */
-    cp->nsent += nw;
-    if (cp->nsent == mp->cl) {
-        if (--mp->count == 0)
-        freeMsg (mp);
-        popFQ (cp->msgq);
-        cp->nsent = 0;
+    /* update amount sent, retire completed messages */
+    cp->npop[cp->lane] += msgQSent (q, &cp->nsent, nw);
+    cp->qbytes -= nw;
     }
 
     return (0);
 }
 
-/* write the next chunk of the current message in the queue to the given
- * driver. pop message from queue when complete and free the message if we are
- * the last one to use it. restart this driver if touble.
+/* write as much of the messages in the queue to the given driver as the
+ * pipe will take, gathering several messages per writev(). pop each message
+ * from queue when complete and free the message if we are the last one to use
+ * it. restart this driver if touble.
  * N.B. we assume we will never be called with dp->msgq empty.
  * return 0 if ok else -1 if had to shut down.
  */
 static int
 sendDriverMsg (DvrInfo *dp)
 {
-    ssize_t nsend, nw;
-    Msg *mp;
+    struct iovec iov[MAXIOV];
+    ssize_t nw;
+    int niov;
 
-    /* get current message */
-    mp = (Msg *) peekFQ (dp->msgq);
+    while (nFQ(dp->msgq) > 0) {
+    /* send the unsent part of the current message and those after it */
+    niov = msgQIOV (dp->msgq, dp->nsent, iov);
+    nw = writev (dp->wfd, iov, niov);
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    nsend = mp->cl - dp->nsent;
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
-    nw = write (dp->wfd, &mp->cp[dp->nsent], nsend);
+    /* done for now if pipe is full */
+    if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
 
     /* restart if trouble */
     if (nw <= 0) {
@@ -1803,28 +2969,217 @@ sendDriverMsg (DvrInfo *dp)
 
     /* trace */
     if (verbose > 2) {
-        fprintf(stderr, "%s: Driver %s: sending msg copy %d nq %d:\n%.*s\n",
-                indi_tstamp(NULL), dp->name, mp->count, nFQ(dp->msgq),
-                (int)nw, &mp->cp[dp->nsent]);
+        Msg *mp = (Msg *) peekFQ (dp->msgq);
+        fprintf(stderr, "%s: Driver %s: sending %ld bytes of %d msgs, msg copy %d nq %d:\n%.*s\n",
+                indi_tstamp(NULL), dp->name, (long)nw, niov, mp->count,
+                nFQ(dp->msgq), (int)((size_t)nw < iov[0].iov_len ? (size_t)nw
+                : iov[0].iov_len), (char *)iov[0].iov_base);
     } else if (verbose > 1) {
         fprintf(stderr, "%s: Driver %s: sending %.50s\n", indi_tstamp(NULL),
-                        dp->name, &mp->cp[dp->nsent]);
+                        dp->name, (char *)iov[0].iov_base);
     }
 
-    /* update amount sent. when complete: free message if we are the last
-     * to use it and pop from our queue.
-     */
-    dp->nsent += nw;
-    if (dp->nsent == mp->cl) {
-        if (--mp->count == 0)
-        freeMsg (mp);
-        popFQ (dp->msgq);
-        dp->nsent = 0;
+    /* update amount sent, retire completed messages */
+    msgQSent (dp->msgq, &dp->nsent, nw);
+    dp->qbytes -= nw;
     }
 
     return (0);
 }
 
+/* fill iov with the unsent content of up to MAXIOV messages at the head of q,
+ * of which the first already has nsent bytes sent.
+ * return number of iov entries used.
+ */
+static int
+msgQIOV (FQ *q, unsigned int nsent, struct iovec iov[])
+{
+    int i, n = nFQ(q);
+
+    if (n > MAXIOV)
+        n = MAXIOV;
+    for (i = 0; i < n; i++) {
+        Msg *mp = (Msg *) peekiFQ (q, i);
+        iov[i].iov_base = &mp->cp[nsent];
+        iov[i].iov_len = mp->cl - nsent;
+        nsent = 0;
+    }
+
+    return (n);
+}
+
+/* account for nw more bytes written from the head of q, where *nsentp bytes
+ * of the first message had already been sent. pop each message now complete
+ * and free it if we are the last one to use it.
+ * return number of messages popped.
+ */
+static int
+msgQSent (FQ *q, unsigned int *nsentp, ssize_t nw)
+{
+    int npop = 0;
+
+    while (nw > 0) {
+        Msg *mp = (Msg *) peekFQ (q);
+        ssize_t left = mp->cl - *nsentp;
+
+        if (nw < left) {
+            *nsentp += nw;
+            break;
+        }
+
+        nw -= left;
+        if (--mp->count == 0)
+            freeMsg (mp);
+        popFQ (q);
+        *nsentp = 0;
+        npop++;
+    }
+
+    return (npop);
+}
+
+/* create the write thread job queues, the pipe they use to wake the main
+ * loop and nwthreads threads. threads block our signals, those are for main.
+ */
+static void
+startWriters (void)
+{
+    sigset_t all, old;
+    pthread_t tid;
+    int i;
+
+    wtodo = newFQ(16);
+    wdone = newFQ(16);
+    if (pipe (wpipe) < 0) {
+        fprintf (stderr, "%s: pipe: %s\n", indi_tstamp(NULL), strerror(errno));
+        Bye();
+    }
+    setNonBlock (wpipe[0]);
+    setNonBlock (wpipe[1]);
+#ifdef USE_EPOLL
+    epollCtl (EPOLL_CTL_ADD, wpipe[0], EPOLLIN, EV_WRITER, 0);
+#endif
+
+    sigfillset (&all);
+    pthread_sigmask (SIG_SETMASK, &all, &old);
+    for (i = 0; i < nwthreads; i++) {
+        if (pthread_create (&tid, NULL, writerThread, NULL) != 0) {
+            fprintf (stderr, "%s: can not create write thread\n",
+                                                    indi_tstamp(NULL));
+            Bye();
+        }
+        pthread_detach (tid);
+    }
+    pthread_sigmask (SIG_SETMASK, &old, NULL);
+
+    if (verbose > 0)
+        fprintf (stderr, "%s: %d write threads for messages >= %lu bytes\n",
+                                indi_tstamp(NULL), nwthreads, wthresh);
+}
+
+/* forever take the next job from wtodo, write it and pass it to wdone.
+ * touches only the job, never clinfo[] or the Msg pools.
+ */
+static void *
+writerThread (void *arg)
+{
+    WJob *jp;
+
+    for (;;) {
+        pthread_mutex_lock (&wlock);
+        while (nFQ(wtodo) == 0)
+            pthread_cond_wait (&wcond, &wlock);
+        jp = (WJob *) popFQ (wtodo);
+        pthread_mutex_unlock (&wlock);
+
+        writeJob (jp);
+
+        pthread_mutex_lock (&wlock);
+        pushFQ (wdone, jp);
+        pthread_mutex_unlock (&wlock);
+
+        /* a full pipe already has the main loop's attention */
+        if (write (wpipe[1], "", 1) < 0 && errno != EAGAIN)
+            fprintf (stderr, "%s: write thread pipe: %s\n", indi_tstamp(NULL),
+                                    strerror(errno));
+    }
+
+    return (arg);
+}
+
+/* write the rest of jp->mp to jp->fd, waiting for room as needed.
+ * a client shut down meanwhile makes the write fail, leaving jp->err set.
+ */
+static void
+writeJob (WJob *jp)
+{
+    while (jp->off < jp->mp->cl) {
+        ssize_t nw = write (jp->fd, jp->mp->cp + jp->off, jp->mp->cl - jp->off);
+
+        if (nw > 0)
+            jp->off += nw;
+        else if (nw < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd;
+            pfd.fd = jp->fd;
+            pfd.events = POLLOUT;
+            poll (&pfd, 1, -1);
+        } else if (nw < 0 && errno == EINTR)
+            continue;
+        else {
+            jp->err = nw < 0 ? errno : EPIPE;
+            return;
+        }
+    }
+}
+
+/* take back each finished write job: account for what was sent and carry
+ * on with the rest of the client's queue, or finish closing a client that
+ * was shut down while the thread was writing.
+ */
+static void
+writersDone (void)
+{
+    char buf[64];
+    WJob *jp;
+
+    while (read (wpipe[0], buf, sizeof(buf)) > 0)
+        continue;
+
+    for (;;) {
+        ClInfo *cp;
+
+        pthread_mutex_lock (&wlock);
+        jp = (WJob *) popFQ (wdone);
+        pthread_mutex_unlock (&wlock);
+        if (!jp)
+            break;
+        cp = &clinfo[jp->slot];
+
+        cp->wbusy = 0;
+        if (!cp->active)
+            close (jp->fd);
+        else if (jp->err) {
+            fprintf (stderr, "%s: Client %d: write: %s\n", indi_tstamp(NULL),
+                                cp->s, strerror(jp->err));
+            shutdownClient (cp);
+        } else {
+            ssize_t nw = jp->off - cp->nsent;
+            if (verbose > 1)
+                fprintf (stderr, "%s: Client %d: write thread sent %ld bytes\n",
+                                indi_tstamp(NULL), cp->s, (long)nw);
+            cp->npop[cp->lane] += msgQSent (cp->msgq[cp->lane], &cp->nsent,
+                                                                        nw);
+            cp->qbytes -= nw;
+            if (nClientMsg(cp) > 0)
+                sendClientMsg (cp);
+        }
+
+        if (--jp->mp->count == 0)
+            freeMsg (jp->mp);
+        free (jp);
+    }
+}
+
 /* return 0 if cp may be interested in dev/name else -1
  */
 static int
@@ -1849,6 +3204,7 @@ static void
 addClDevice (ClInfo *cp, const char *dev, const char *name, int isblob)
 {
     Property *pp;
+    Route *rp;
     //char *ip;
         int i=0;
 
@@ -1878,9 +3234,204 @@ addClDevice (ClInfo *cp, const char *dev, const char *name, int isblob)
     strncpy (ip, name, MAXINDINAME-1);
         ip[MAXINDINAME-1] = '\0';*/
 
-        strncpy (pp->dev, dev, MAXINDIDEVICE);
-        strncpy (pp->name, name, MAXINDINAME);
+        strncpy (pp->dev, dev, MAXINDIDEVICE-1);
+        pp->dev[MAXINDIDEVICE-1] = '\0';
+        strncpy (pp->name, name, MAXINDINAME-1);
+        pp->name[MAXINDINAME-1] = '\0';
         pp->blob = B_NEVER;
+
+        rp = findRoute (pp->dev, pp->name, 1);
+        addSub (&rp->cl, &rp->ncl, cp - clinfo, cp->nprops-1);
+}
+
+/* return FNV-1a hash of dev and name */
+static unsigned
+routeHash (const char *dev, const char *name)
+{
+    unsigned h = 2166136261u;
+
+    while (*dev)
+        h = (h ^ (unsigned char)*dev++) * 16777619u;
+    h *= 16777619u;		/* as if the \0 between them */
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return (h);
+}
+
+/* return the Route for dev and name.
+ * if none: add one if create, else return NULL.
+ */
+static Route *
+findRoute (const char *dev, const char *name, int create)
+{
+    unsigned h = routeHash (dev, name);
+    Route *rp;
+
+    for (rp = nroutes ? routes[h & (nroutes-1)] : NULL; rp; rp = rp->next)
+        if (rp->hash == h && !strcmp (rp->dev, dev) && !strcmp (rp->name, name))
+            return (rp);
+    if (!create)
+        return (NULL);
+
+    /* keep chains short, doubling the buckets when they average one */
+    if (nroute >= nroutes) {
+        int n = nroutes ? 2*nroutes : NROUTES;
+        Route **newroutes = (Route **) calloc (n, sizeof(Route *));
+        int i;
+
+        if (!newroutes) {
+            fprintf (stderr, "%s: no memory for routes\n", indi_tstamp(NULL));
+            Bye();
+        }
+        for (i = 0; i < nroutes; i++) {
+            while ((rp = routes[i]) != NULL) {
+                routes[i] = rp->next;
+                rp->next = newroutes[rp->hash & (n-1)];
+                newroutes[rp->hash & (n-1)] = rp;
+            }
+        }
+        free (routes);
+        routes = newroutes;
+        nroutes = n;
+    }
+
+    rp = (Route *) calloc (1, sizeof(Route));
+    if (!rp) {
+        fprintf (stderr, "%s: no memory for route\n", indi_tstamp(NULL));
+        Bye();
+    }
+    rp->hash = h;
+    strncpy (rp->dev, dev, MAXINDIDEVICE-1);
+    strncpy (rp->name, name, MAXINDINAME-1);
+    rp->next = routes[h & (nroutes-1)];
+    routes[h & (nroutes-1)] = rp;
+    nroute++;
+
+    return (rp);
+}
+
+/* append slot and its prop index to the malloced subs list */
+static void
+addSub (Sub **subsp, int *nsubsp, int slot, int prop)
+{
+    Sub *sb;
+
+    *subsp = (Sub *) realloc (*subsp, (*nsubsp+1)*sizeof(Sub));
+    if (!*subsp) {
+        fprintf (stderr, "%s: no memory for route\n", indi_tstamp(NULL));
+        Bye();
+    }
+    sb = &(*subsp)[(*nsubsp)++];
+    sb->slot = slot;
+    sb->prop = prop;
+}
+
+/* remove all entries for slot from the subs list, order is not kept */
+static void
+rmSub (Sub *subs, int *nsubsp, int slot)
+{
+    int i;
+
+    for (i = 0; i < *nsubsp; )
+        if (subs[i].slot == slot)
+            subs[i] = subs[--(*nsubsp)];
+        else
+            i++;
+}
+
+/* note dp serves dev */
+static void
+routeDvrDevice (DvrInfo *dp, const char *dev)
+{
+    Route *rp = findRoute (dev, "", 1);
+
+    addSub (&rp->own, &rp->nown, dp - dvrinfo, -1);
+}
+
+/* remove dp from all the routes its devices and snoops put it on */
+static void
+unrouteDvr (DvrInfo *dp)
+{
+    Route *rp;
+    int i;
+
+    for (i = 0; i < dp->ndev; i++)
+        if ((rp = findRoute (dp->dev[i], "", 0)) != NULL)
+            rmSub (rp->own, &rp->nown, dp - dvrinfo);
+    for (i = 0; i < dp->nsprops; i++)
+        if ((rp = findRoute (dp->sprops[i].dev, dp->sprops[i].name, 0)) != NULL)
+            rmSub (rp->sd, &rp->nsd, dp - dvrinfo);
+}
+
+/* remove cp from all the routes its props put it on */
+static void
+unrouteClient (ClInfo *cp)
+{
+    Route *rp;
+    int i;
+
+    for (i = 0; i < cp->nprops; i++)
+        if ((rp = findRoute (cp->props[i].dev, cp->props[i].name, 0)) != NULL)
+            rmSub (rp->cl, &rp->ncl, cp - clinfo);
+    for (i = 0; i < nallcl; i++)
+        if (allcl[i] == cp - clinfo)
+            allcl[i--] = allcl[--nallcl];
+}
+
+/* fill clroute[] with the clinfo[] slots of each active client other than
+ * notme interested in dev/name, each once, with its rprop set to the props[]
+ * entry for exactly dev/name if it has one. return the number found.
+ */
+static int
+routeClients (ClInfo *notme, const char *dev, const char *name)
+{
+    Route *rp;
+    int i, n = 0;
+
+    if (!name)
+        name = "";
+    if (nclroute < nclinfo) {
+        clroute = (int *) realloc (clroute, nclinfo*sizeof(int));
+        nclroute = nclinfo;
+    }
+    routeseq++;
+
+    /* exact property first, it carries any per property BLOB mode */
+    if ((rp = findRoute (dev, name, 0)) != NULL)
+        for (i = 0; i < rp->ncl; i++)
+            n = addClRoute (notme, rp->cl[i].slot, rp->cl[i].prop, n);
+
+    /* no device goes to everyone */
+    if (!dev[0]) {
+        for (i = 0; i < nclinfo; i++)
+            n = addClRoute (notme, i, -1, n);
+        return (n);
+    }
+
+    /* then all of dev, then clients that want everything */
+    if (name[0] && (rp = findRoute (dev, "", 0)) != NULL)
+        for (i = 0; i < rp->ncl; i++)
+            n = addClRoute (notme, rp->cl[i].slot, -1, n);
+    for (i = 0; i < nallcl; i++)
+        n = addClRoute (notme, allcl[i], -1, n);
+
+    return (n);
+}
+
+/* add slot with prop to clroute[n] unless notme, inactive or already there.
+ * return new n.
+ */
+static int
+addClRoute (ClInfo *notme, int slot, int prop, int n)
+{
+    ClInfo *cp = &clinfo[slot];
+
+    if (!cp->active || cp == notme || cp->rseq == routeseq)
+        return (n);
+    cp->rseq = routeseq;
+    cp->rprop = prop;
+    clroute[n++] = slot;
+    return (n);
 }
 
 
@@ -1903,9 +3454,156 @@ newClSocket ()
     }
 
     /* ok */
+    setNonBlock (cli_fd);
     return (cli_fd);
 }
 
+/* set O_NONBLOCK on fd, we always read and write until EAGAIN */
+static void
+setNonBlock (int fd)
+{
+    int flags = fcntl (fd, F_GETFL, 0);
+
+    if (flags < 0 || fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        fprintf (stderr, "%s: fcntl(%d): %s\n", indi_tstamp(NULL), fd,
+                                strerror(errno));
+        Bye();
+    }
+}
+
+/* set cp's conflation from the value of enableConflate.
+ * no change if unrecognized.
+ */
+static void
+crackConflate (const char *enableConflate, ClInfo *cp)
+{
+    if (!strcmp (enableConflate, "On"))
+        cp->conflate = C_ON;
+    else if (!strcmp (enableConflate, "WithBLOBs"))
+        cp->conflate = C_BLOBS;
+    else if (!strcmp (enableConflate, "Off"))
+        cp->conflate = C_OFF;
+    else
+        return;
+
+    if (verbose > 0)
+        fprintf (stderr, "%s: Client %d: conflate %s\n", indi_tstamp(NULL),
+                                                    cp->s, enableConflate);
+}
+
+/* queue mp on lane for a conflating client cp, replacing in place an older
+ * message for the same tag, device and property if one is still waiting.
+ * only set*Vector without a message attribute are conflated, since a message
+ * is meant to be seen, and setBLOBVector only if asked for. this relies on
+ * the vector carrying all its members, as drivers built on libindi do.
+ * return 1 if mp was queued, 0 if it is not for conflating.
+ */
+static int
+conflateClientMsg (ClInfo *cp, Msg *mp, XMLEle *root, Lane lane)
+{
+    const char *tag = tagXMLEle (root);
+    const char *dev = findXMLAttValu (root, "device");
+    const char *name = findXMLAttValu (root, "name");
+    unsigned h;
+    Conf *cf;
+    int pos;
+
+    if (strncmp (tag, "set", 3) || strlen (tag) >= MAXCONFTAG
+                                || findXMLAttValu (root, "message")[0])
+        return (0);
+    if (lane == LANE_BULK && cp->conflate != C_BLOBS)
+        return (0);
+
+    if (!cp->nconf)
+        growConf (cp);
+    h = confHash (tag, dev, name);
+    cf = &cp->conf[h & (cp->nconf-1)];
+
+    /* same property still waiting: put mp in its place */
+    if (cf->mp && cf->hash == h && cf->lane == lane && !strcmp (cf->tag, tag)
+                && !strcmp (cf->dev, dev) && !strcmp (cf->name, name)
+                && (pos = queuedConf (cp, cf)) >= 0) {
+        setiFQ (cp->msgq[lane], pos, mp);
+        mp->count++;
+        cp->qbytes += mp->cl;
+        cp->qbytes -= cf->mp->cl;
+        if (--cf->mp->count == 0)
+            freeMsg (cf->mp);
+        cf->mp = mp;
+        cp->nconflated++;
+        return (1);
+    }
+
+    /* slot holds another one still waiting: try for more slots. if that
+     * does not help the other one is just no longer conflated.
+     */
+    if (cf->mp && cp->nconf < MAXCONF && queuedConf (cp, cf) >= 0) {
+        growConf (cp);
+        cf = &cp->conf[h & (cp->nconf-1)];
+    }
+
+    pushClientMsg (cp, mp, lane);
+    cf->mp = mp;
+    cf->seq = cp->npush[lane] - 1;
+    cf->hash = h;
+    cf->lane = lane;
+    strcpy (cf->tag, tag);
+    strncpy (cf->dev, dev, MAXINDIDEVICE-1);
+    cf->dev[MAXINDIDEVICE-1] = '\0';
+    strncpy (cf->name, name, MAXINDINAME-1);
+    cf->name[MAXINDINAME-1] = '\0';
+    return (1);
+}
+
+/* return hash of a conflated tag, dev and name */
+static unsigned
+confHash (const char *tag, const char *dev, const char *name)
+{
+    /* set*Vector tags differ right after "set" */
+    return (routeHash (dev, name) ^ ((unsigned char)tag[3] * 2654435761u));
+}
+
+/* return the position of cf->mp in its queue if it may still be replaced,
+ * else -1 if it has been sent or has started to be.
+ */
+static int
+queuedConf (ClInfo *cp, Conf *cf)
+{
+    FQ *q = cp->msgq[cf->lane];
+    int pos;
+
+    if (cf->seq < cp->npop[cf->lane])
+        return (-1);
+    pos = cf->seq - cp->npop[cf->lane];
+    if (pos >= nFQ(q) || peekiFQ (q, pos) != cf->mp)
+        return (-1);
+    if (pos == 0 && cf->lane == cp->lane && (cp->nsent > 0 || cp->wbusy))
+        return (-1);
+    return (pos);
+}
+
+/* double the Conf slots of cp, keeping those still waiting */
+static void
+growConf (ClInfo *cp)
+{
+    int n = cp->nconf ? 2*cp->nconf : NCONF;
+    Conf *conf = (Conf *) calloc (n, sizeof(Conf));
+    int i;
+
+    if (!conf) {
+        fprintf (stderr, "%s: no memory for conflation\n", indi_tstamp(NULL));
+        Bye();
+    }
+    for (i = 0; i < cp->nconf; i++) {
+        Conf *cf = &cp->conf[i];
+        if (cf->mp && queuedConf (cp, cf) >= 0)
+            conf[cf->hash & (n-1)] = *cf;
+    }
+    free (cp->conf);
+    cp->conf = conf;
+    cp->nconf = n;
+}
+
 /* convert the string value of enableBLOB to our B_ state value.
  * no change if unrecognized
  */
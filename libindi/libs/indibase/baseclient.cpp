@@ -26,15 +26,158 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
 #include <pthread.h>
+#include <zlib.h>
 
 #include "baseclient.h"
 #include "basedevice.h"
 #include "indicom.h"
+#include "base64.h"
 
 #include <errno.h>
+#include <limits.h>
 
-#define MAXINDIBUF 256
+#define MAXINDIBUF 32768
+#define BLOBSTREAMBUF 32768
+#define MAXATTACHED INT_MAX         // most binary BLOB bytes after one setBLOBVector
+
+/* a BLOB on its way to a sink, see setBLOBSink() */
+struct INDI::BaseClient::BLOBStream
+{
+    XMLEle *ep;                         // oneBLOB being streamed, NULL if none
+    IBLOB *bp;                          // its BLOB
+    INDI::BLOBSink *sink;
+    bool begun;                         // sink took the BLOB
+    bool ok;                            // false once the rest is dropped
+    bool inflating;                     // format ended with .z
+    bool inflated;                      // end of the deflate stream seen
+    int len;                            // bytes written to the sink
+    z_stream zs;
+    Base64Carry carry;
+    unsigned char in[BLOBSTREAMBUF];    // decoded or received bytes
+    unsigned char out[BLOBSTREAMBUF];   // inflated bytes
+};
+
+/* return the total of the attached='N' binary BLOB bytes that follow a
+ * setBLOBVector from the server, 0 if it was sent as base64, or -1 if an N
+ * is not a byte count or they add up to more than MAXATTACHED.
+ */
+static int attachedBLOBLen(XMLEle *root)
+{
+    size_t len=0;
+
+    if (strcmp(tagXMLEle(root), "setBLOBVector"))
+        return 0;
+
+    for (XMLEle *ep = nextXMLEle(root,1); ep; ep = nextXMLEle(root,0))
+    {
+        XMLAtt *aa = findXMLAtt(ep, "attached");
+        if (aa && !strcmp(tagXMLEle(ep), "oneBLOB"))
+        {
+            const char *valu = valuXMLAtt(aa);
+            char *end;
+
+            errno = 0;
+            long n = strtol(valu, &end, 10);
+            if (end == valu || *end != '\0' || errno || n < 0 || (size_t) n > MAXATTACHED - len)
+                return -1;
+
+            len += n;
+        }
+    }
+
+    return (int) len;
+}
+
+/* receive up to len bytes from the nonblocking fd, waiting for some if none
+ * have arrived yet. return as recv(), or -1 with errno ECANCELED if wakefd
+ * became readable first, which is how disconnectServer() stops the listener.
+ */
+static int recvWait(int fd, int wakefd, void *buf, int len)
+{
+    for (;;)
+    {
+        int nr = recv(fd, buf, len, 0);
+        if (nr >= 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+            return nr;
+
+        if (errno != EINTR)
+        {
+            struct pollfd pfd[2] = { { fd, POLLIN, 0 }, { wakefd, POLLIN, 0 } };
+            if (poll(pfd, 2, -1) > 0 && pfd[1].revents)
+            {
+                errno = ECANCELED;
+                return -1;
+            }
+        }
+    }
+}
+
+INDI::FileBLOBSink::FileBLOBSink(const char *prefix) : prefix(prefix)
+{
+    fp = NULL;
+    seq = 0;
+}
+
+INDI::FileBLOBSink::~FileBLOBSink()
+{
+    if (fp)
+        fclose(fp);
+}
+
+const char * INDI::FileBLOBSink::getFileName(IBLOB *bp)
+{
+    map<IBLOB *, string>::const_iterator fi = fileNames.find(bp);
+
+    return (fi == fileNames.end()) ? NULL : fi->second.c_str();
+}
+
+bool INDI::FileBLOBSink::beginBLOB(IBLOB *bp, int size)
+{
+    char name[MAXRBUF];
+
+    INDI_UNUSED(size);
+
+    snprintf(name, MAXRBUF, "%s%d%s", prefix.c_str(), ++seq, bp->format);
+    fileNames[bp] = name;
+
+    fp = fopen(name, "w");
+    if (fp == NULL)
+    {
+        IDLog("Unable to create %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool INDI::FileBLOBSink::writeBLOB(IBLOB *bp, const unsigned char *data, int len)
+{
+    if (fwrite(data, 1, len, fp) != (size_t) len)
+    {
+        IDLog("Unable to write %s: %s\n", getFileName(bp), strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void INDI::FileBLOBSink::endBLOB(IBLOB *bp, bool ok)
+{
+    if (fclose(fp) != 0 && ok)
+    {
+        IDLog("Unable to write %s: %s\n", getFileName(bp), strerror(errno));
+        ok = false;
+    }
+    fp = NULL;
+
+    if (!ok)
+    {
+        unlink(getFileName(bp));
+        fileNames.erase(bp);
+    }
+}
 
 INDI::BaseClient::BaseClient()
 {
@@ -47,11 +190,14 @@ INDI::BaseClient::BaseClient()
     timeout_sec=3;
     timeout_us=0;
 
+    blobStream = NULL;
 }
 
 
 INDI::BaseClient::~BaseClient()
 {
+    delete blobStream;
+
    // close(m_sendFd);
    // close(m_receiveFd);
 }
@@ -305,23 +451,24 @@ void INDI::BaseClient::listenINDI()
 
     int n=0, err_code=0;
     int maxfd=0;
+    bool lost=false;
     fd_set rs;
 
     char *orig = setlocale(LC_NUMERIC,"C");
     if (cDeviceNames.empty())
     {
-       fprintf(svrwfp, "<getProperties version='%g'/>\n", INDIV);
+       fprintf(svrwfp, "<getProperties version='%g' binaryBLOB='On'/>\n", INDIV);
        if (verbose)
-           fprintf(stderr, "<getProperties version='%g'/>\n", INDIV);
+           fprintf(stderr, "<getProperties version='%g' binaryBLOB='On'/>\n", INDIV);
     }
     else
     {
         vector<string>::const_iterator stri;
         for ( stri = cDeviceNames.begin(); stri != cDeviceNames.end(); stri++)
         {
-            fprintf(svrwfp, "<getProperties version='%g' device='%s'/>\n", INDIV, (*stri).c_str());
+            fprintf(svrwfp, "<getProperties version='%g' device='%s' binaryBLOB='On'/>\n", INDIV, (*stri).c_str());
             if (verbose)
-                fprintf(stderr, "<getProperties version='%g' device='%s'/>\n", INDIV, (*stri).c_str());
+                fprintf(stderr, "<getProperties version='%g' device='%s' binaryBLOB='On'/>\n", INDIV, (*stri).c_str());
         }
     }
     setlocale(LC_NUMERIC,orig);
@@ -340,6 +487,8 @@ void INDI::BaseClient::listenINDI()
 
 
     lillp = newLilXML();
+    arenaLilXML (lillp, 1);
+    pcdataLilXML (lillp, blobPCData, this);
 
     /* read from server, exit if find all requested properties */
     while (sConnected)
@@ -378,16 +527,74 @@ void INDI::BaseClient::listenINDI()
                     continue;
             }
 
-            for (int i=0; i < n; i++)
+            int used;
+            for (int i=0; i < n; i += used)
             {
-               XMLEle *root = readXMLEle (lillp, buffer[i], msg);
+               XMLEle *root = readXMLChunk (lillp, buffer+i, n-i, &used, msg);
 
                 if (root)
                 {
+                    // the last base64 BLOB streamed, if any, is complete
+                    finishBLOBStream();
+
                     if (verbose)
                         prXMLEle(stderr, root, 0);
 
-                    if ( (err_code = dispatchCommand(root, msg)) < 0)
+                    // Binary BLOBs follow the element, take what we have and wait for the rest
+                    int nattached = attachedBLOBLen(root);
+                    unsigned char *attached = NULL;
+                    if (nattached < 0)
+                    {
+                        fprintf (stderr, "Bad attached BLOB length from %s/%d\n", cServer.c_str(), cPort);
+                        lost = true;
+                        delXMLEle (root);
+                        break;
+                    }
+                    else if (nattached > 0 && findBLOBSink(root))
+                    {
+                        int nused = streamAttachedBLOBs(root, buffer+i+used, n-i-used);
+                        if (nused < 0)
+                        {
+                            lost = true;
+                            delXMLEle (root);
+                            break;
+                        }
+                        used += nused;
+                    }
+                    else if (nattached > 0)
+                    {
+                        int have = (n-i-used < nattached) ? n-i-used : nattached;
+                        attached = (unsigned char *) malloc(nattached);
+                        if (attached == NULL)
+                        {
+                            fprintf (stderr, "No memory for %d bytes of BLOB from %s/%d\n", nattached, cServer.c_str(), cPort);
+                            lost = true;
+                        }
+                        else
+                        {
+                            memcpy(attached, buffer+i+used, have);
+                            used += have;
+                            for (int nr; have < nattached; have += nr)
+                            {
+                                nr = recvWait(sockfd, m_receiveFd, attached+have, nattached-have);
+                                if (nr <= 0)
+                                {
+                                    fprintf (stderr,"INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
+                                    lost = true;
+                                    break;
+                                }
+                            }
+                        }
+
+                        if (lost)
+                        {
+                            free(attached);
+                            delXMLEle (root);
+                            break;
+                        }
+                    }
+
+                    if ( (err_code = dispatchCommand(root, msg, attached)) < 0)
                     {
                          // Silenty ignore property duplication errors
                          if (err_code != INDI_PROPERTY_DUPLICATED)
@@ -398,20 +605,28 @@ void INDI::BaseClient::listenINDI()
                     }
 
 
+                   free (attached);
                    delXMLEle (root);	// not yet, delete and continue
                 }
                 else if (msg[0])
                 {
                    fprintf (stderr, "Bad XML from %s/%d: %s\n%s\n", cServer.c_str(), cPort, msg, buffer);
+                   finishBLOBStream(false);
                    return;
                 }
             }
 
-
+            if (lost)
+            {
+                close(sockfd);
+                break;
+            }
         }
 
     }
 
+    // a BLOB cut short by the server going away
+    finishBLOBStream(false);
     delLilXML(lillp);
 
     serverDisconnected( (sConnected == false) ? 0 : -1);
@@ -421,7 +636,7 @@ void INDI::BaseClient::listenINDI()
 
 }
 
-int INDI::BaseClient::dispatchCommand(XMLEle *root, char * errmsg)
+int INDI::BaseClient::dispatchCommand(XMLEle *root, char * errmsg, const unsigned char *attached)
 {
     if  (!strcmp (tagXMLEle(root), "message"))
         return messageCmd(root, errmsg);
@@ -453,7 +668,7 @@ int INDI::BaseClient::dispatchCommand(XMLEle *root, char * errmsg)
              !strcmp (tagXMLEle(root), "setSwitchVector") ||
              !strcmp (tagXMLEle(root), "setLightVector") ||
              !strcmp (tagXMLEle(root), "setBLOBVector"))
-            return dp->setValue(root, errmsg);
+            return dp->setValue(root, errmsg, attached);
 
     return INDI_DISPATCH_ERROR;
 }
@@ -810,5 +1025,263 @@ void INDI::BaseClient::setBLOBMode(BLOBHandling blobH, const char *dev, const ch
     fflush(svrwfp);
 }
 
+void INDI::BaseClient::setBLOBSink(INDI::BLOBSink *sink, const char *dev, const char *prop)
+{
+    if (!dev[0])
+        return;
+
+    string key(dev);
+    if (prop != NULL)
+        key = key + "." + prop;
+
+    if (sink)
+        blobSinks[key] = sink;
+    else
+        blobSinks.erase(key);
+}
+
+/* return the sink for the BLOBs of the setBLOBVector root, NULL if none */
+INDI::BLOBSink * INDI::BaseClient::findBLOBSink(XMLEle *root)
+{
+    if (blobSinks.empty() || strcmp(tagXMLEle(root), "setBLOBVector"))
+        return NULL;
+
+    string dev(findXMLAttValu(root, "device"));
+
+    map<string, INDI::BLOBSink *>::const_iterator si = blobSinks.find(dev + "." + findXMLAttValu(root, "name"));
+    if (si == blobSinks.end())
+        si = blobSinks.find(dev);
+
+    return (si == blobSinks.end()) ? NULL : si->second;
+}
+
+/* start streaming the oneBLOB ep to the sink of its property.
+ * return false if it has none, so the BLOB is handled whole as usual.
+ */
+bool INDI::BaseClient::startBLOBStream(XMLEle *ep)
+{
+    char errmsg[MAXRBUF];
+    XMLEle *root = parentXMLEle(ep);
+
+    if (root == NULL || strcmp(tagXMLEle(ep), "oneBLOB"))
+        return false;
+
+    INDI::BLOBSink *sink = findBLOBSink(root);
+    if (sink == NULL)
+        return false;
+
+    /* Blob size = 0 when only state changes */
+    int size = atoi(findXMLAttValu(ep, "size"));
+    if (size <= 0)
+        return false;
+
+    INDI::BaseDevice *dp = findDev(findXMLAttValu(root, "device"), errmsg);
+    IBLOBVectorProperty *bvp = dp ? dp->getBLOB(findXMLAttValu(root, "name")) : NULL;
+    IBLOB *bp = bvp ? IUFindBLOB(bvp, findXMLAttValu(ep, "name")) : NULL;
+    if (bp == NULL)
+        return false;
+
+    if (blobStream == NULL)
+        blobStream = new BLOBStream();
+    BLOBStream *bs = blobStream;
+
+    bs->ep = ep;
+    bs->bp = bp;
+    bs->sink = sink;
+    bs->len = 0;
+    bs->inflated = false;
+    memset(&bs->carry, 0, sizeof(bs->carry));
+
+    strncpy(bp->format, findXMLAttValu(ep, "format"), MAXINDIFORMAT);
+    size_t fmtlen = strlen(bp->format);
+    bs->inflating = (fmtlen > 2 && strcmp(bp->format + fmtlen - 2, ".z") == 0);
+    if (bs->inflating)
+    {
+        bp->format[strlen(bp->format)-2] = '\0';
+        memset(&bs->zs, 0, sizeof(bs->zs));
+        if (inflateInit(&bs->zs) != Z_OK)
+            bs->inflating = false;
+    }
+
+    free(bp->blob);
+    bp->blob = NULL;
+    bp->bloblen = 0;
+    bp->size = size;
+
+    bs->begun = sink->beginBLOB(bp, size);
+    bs->ok = bs->begun;
+
+    return true;
+}
+
+/* inflate if need be and write the next len bytes of the BLOB being streamed */
+void INDI::BaseClient::feedBLOBStream(const unsigned char *data, int len)
+{
+    BLOBStream *bs = blobStream;
+
+    if (!bs->ok || len <= 0)
+        return;
+
+    if (!bs->inflating)
+    {
+        bs->ok = bs->sink->writeBLOB(bs->bp, data, len);
+        bs->len += len;
+        return;
+    }
+
+    bs->zs.next_in = (Bytef *) data;
+    bs->zs.avail_in = len;
+    do
+    {
+        bs->zs.next_out = bs->out;
+        bs->zs.avail_out = BLOBSTREAMBUF;
+
+        int r = inflate(&bs->zs, Z_NO_FLUSH);
+        if (r == Z_STREAM_END)
+            bs->inflated = true;
+        else if (r != Z_OK && r != Z_BUF_ERROR)
+        {
+            IDLog("INDI: %s.%s.%s compression error: %d\n", bs->bp->bvp->device, bs->bp->bvp->name, bs->bp->name, r);
+            bs->ok = false;
+            return;
+        }
+
+        int nout = BLOBSTREAMBUF - bs->zs.avail_out;
+        if (nout > 0)
+        {
+            bs->ok = bs->sink->writeBLOB(bs->bp, bs->out, nout);
+            bs->len += nout;
+        }
+    } while (bs->ok && !bs->inflated && (bs->zs.avail_in > 0 || bs->zs.avail_out == 0));
+}
+
+/* end the BLOB being streamed, if any, and mark its oneBLOB with the bytes
+ * written so setBLOB() only notifies, or -1 if it was dropped. a BLOB cut
+ * short by an XML error or disconnect only ends the sink.
+ */
+void INDI::BaseClient::finishBLOBStream(bool complete)
+{
+    BLOBStream *bs = blobStream;
+    char len[32];
+
+    if (bs == NULL || bs->ep == NULL)
+        return;
+
+    if (!complete)
+        bs->ok = false;
+    else if (bs->ok && (bs->carry.n > 0 || (bs->inflating && !bs->inflated)))
+    {
+        IDLog("INDI: %s.%s.%s BLOB is incomplete\n", bs->bp->bvp->device, bs->bp->bvp->name, bs->bp->name);
+        bs->ok = false;
+    }
+
+    if (bs->inflating)
+        inflateEnd(&bs->zs);
+
+    if (bs->begun)
+        bs->sink->endBLOB(bs->bp, bs->ok);
+
+    bs->bp->bloblen = bs->ok ? bs->len : 0;
+    bs->bp->size = bs->bp->bloblen;
+
+    // the parser may already have freed the element on an XML error
+    if (complete)
+    {
+        snprintf(len, sizeof(len), "%d", bs->ok ? bs->len : -1);
+        addXMLAtt(bs->ep, "streamed", len);
+    }
+    bs->ep = NULL;
+}
+
+/* stream the binary BLOBs that follow root to their sink, taking those of
+ * the nhave bytes at have first. return how many of them were used, or -1 if
+ * the server was lost.
+ */
+int INDI::BaseClient::streamAttachedBLOBs(XMLEle *root, const char *have, int nhave)
+{
+    int used = 0;
+
+    if (blobStream == NULL)
+        blobStream = new BLOBStream();
+
+    for (XMLEle *ep = nextXMLEle(root,1); ep; ep = nextXMLEle(root,0))
+    {
+        XMLAtt *aa = findXMLAtt(ep, "attached");
+        if (!aa || strcmp(tagXMLEle(ep), "oneBLOB"))
+            continue;
+
+        int len = atoi(valuXMLAtt(aa));
+        bool streaming = startBLOBStream(ep);
+
+        while (len > 0)
+        {
+            const unsigned char *data;
+            int nd;
+
+            if (used < nhave)
+            {
+                nd = (nhave-used < len) ? nhave-used : len;
+                data = (const unsigned char *) have+used;
+                used += nd;
+            }
+            else
+            {
+                nd = recvWait(sockfd, m_receiveFd, blobStream->in, (len < BLOBSTREAMBUF) ? len : BLOBSTREAMBUF);
+                if (nd <= 0)
+                {
+                    fprintf (stderr,"INDI server %s/%d disconnected.\n", cServer.c_str(), cPort);
+                    finishBLOBStream(false);
+                    return -1;
+                }
+                data = blobStream->in;
+            }
+
+            if (streaming)
+                feedBLOBStream(data, nd);
+            len -= nd;
+        }
+
+        if (streaming)
+            finishBLOBStream();
+        else if (atoi(valuXMLAtt(aa)) > 0)
+            addXMLAtt(ep, "streamed", "-1");
+    }
+
+    return used;
+}
+
+/* lilxml pcdata handler: stream the base64 oneBLOBs of properties with a sink */
+int INDI::BaseClient::blobPCData(XMLEle *ep, const char *pcdata, int len, void *arg)
+{
+    INDI::BaseClient *client = static_cast<INDI::BaseClient *> (arg);
+    BLOBStream *bs = client->blobStream;
+
+    // a new element, so the BLOB before it, if any, is complete
+    if (pcdata == NULL)
+    {
+        client->finishBLOBStream();
+        if (findXMLAtt(ep, "attached"))
+            return 0;
+        return client->startBLOBStream(ep) ? 1 : 0;
+    }
+
+    for (int n; len > 0 && bs->ok; pcdata += n, len -= n)
+    {
+        n = (len < BLOBSTREAMBUF) ? len : BLOBSTREAMBUF;
+
+        int nd = from64tobits_more((char *) bs->in, pcdata, n, &bs->carry);
+        if (nd < 0)
+        {
+            IDLog("INDI: %s.%s.%s bad base64\n", bs->bp->bvp->device, bs->bp->bvp->name, bs->bp->name);
+            bs->ok = false;
+            break;
+        }
+
+        client->feedBLOBStream(bs->in, nd);
+    }
+
+    return 0;
+}
+
 
 
@@ -33,7 +33,64 @@
 
 using namespace std;
 
+/**
+ * \class INDI::BLOBSink
+   \brief Receives BLOBs a piece at a time as they arrive from the server.
+
+   A sink set with INDI::BaseClient::setBLOBSink() is handed each BLOB of its properties while it is still arriving,
+   already decoded and inflated, so a client can store or process frames of any size without holding them in memory.
+   BLOBs reach the sink one at a time from the thread listening to the server.
+*/
+class INDI::BLOBSink
+{
+public:
+    virtual ~BLOBSink() {}
+
+    /** \brief A BLOB starts to arrive.
+        \param bp the BLOB, with its format set without any .z since the data is inflated on the way.
+        \param size the size of the BLOB in bytes as announced by the driver.
+        \return true to receive the BLOB, false to drop it.
+    */
+    virtual bool beginBLOB(IBLOB *bp, int size) = 0;
+
+    /** \brief The next bytes of the BLOB begun last.
+        \return true to carry on, false to drop the rest of the BLOB.
+    */
+    virtual bool writeBLOB(IBLOB *bp, const unsigned char *data, int len) = 0;
 
+    /** \brief The BLOB begun last is over.
+        \param ok true if all of it was written, false if it was cut short.
+    */
+    virtual void endBLOB(IBLOB *bp, bool ok) = 0;
+};
+
+/**
+ * \class INDI::FileBLOBSink
+   \brief BLOB sink that writes each BLOB straight to its own file.
+
+   The file of each BLOB is named after the given prefix, a sequence number and the BLOB format, as in frame_1.fits.
+   A BLOB cut short is removed.
+*/
+class INDI::FileBLOBSink : public INDI::BLOBSink
+{
+public:
+    /** \param prefix path of the files up to the sequence number, such as /data/frame_ */
+    FileBLOBSink(const char *prefix);
+    virtual ~FileBLOBSink();
+
+    /** \return path of the file the BLOB was last written to, NULL if none. */
+    const char * getFileName(IBLOB *bp);
+
+    virtual bool beginBLOB(IBLOB *bp, int size);
+    virtual bool writeBLOB(IBLOB *bp, const unsigned char *data, int len);
+    virtual void endBLOB(IBLOB *bp, bool ok);
+
+private:
+    string prefix;
+    map<IBLOB *, string> fileNames;
+    FILE *fp;
+    int seq;
+};
 
 /**
  * \class INDI::BaseClient
@@ -128,6 +185,22 @@ public:
     */
     void setBLOBMode(BLOBHandling blobH, const char *dev, const char *prop = NULL);
 
+    /** \brief Stream BLOBs to a sink as they arrive
+
+      Instead of collecting each BLOB whole before INDI::BaseMediator::newBLOB() is called, hand it to \e sink
+      piece by piece as it is received, decoding and inflating on the way, so memory use stays the same whatever the
+      size of the BLOB. newBLOB() is still called once each BLOB is complete, with \e blob NULL and \e bloblen the
+      number of bytes written to the sink.
+
+      If \e prop is NULL, the sink applies to all BLOB properties of the device. Set sinks before connectServer(),
+      or from the notification functions.
+
+      \param sink where BLOBs go, or NULL to receive them whole again. The sink must last as long as it is set.
+      \param dev name of device, required.
+      \param prop name of property, optional.
+    */
+    void setBLOBSink(INDI::BLOBSink *sink, const char *dev, const char *prop = NULL);
+
     // Update
     static void * listenHelper(void *context);
 
@@ -176,8 +249,9 @@ public:
 
 protected:
 
-    /** \brief Dispatch command received from INDI server to respective devices handled by the client */
-    int dispatchCommand(XMLEle *root, char* errmsg);
+    /** \brief Dispatch command received from INDI server to respective devices handled by the client.
+        \param attached binary BLOB bytes that followed a setBLOBVector, or NULL */
+    int dispatchCommand(XMLEle *root, char* errmsg, const unsigned char *attached=NULL);
 
     /** \brief Remove device */
     int deleteDevice( const char * devName, char * errmsg );
@@ -208,6 +282,19 @@ private:
     // Listen to INDI server and process incoming messages
     void listenINDI();
 
+    // Stream BLOBs to their sinks, see setBLOBSink()
+    struct BLOBStream;
+    INDI::BLOBSink * findBLOBSink(XMLEle *root);
+    bool startBLOBStream(XMLEle *ep);
+    void feedBLOBStream(const unsigned char *data, int len);
+    void finishBLOBStream(bool complete=true);
+    int streamAttachedBLOBs(XMLEle *root, const char *have, int nhave);
+    static int blobPCData(XMLEle *ep, const char *pcdata, int len, void *arg);
+
+    // sinks by device or device.property, and the BLOB being streamed
+    map<string, INDI::BLOBSink *> blobSinks;
+    BLOBStream *blobStream;
+
     // Thread for listenINDI()
     pthread_t listen_thread;
 
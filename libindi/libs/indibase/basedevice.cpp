@@ -25,6 +25,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "config.h"
 #include "basedevice.h"
 #include "baseclient.h"
@@ -52,6 +54,7 @@ INDI::BaseDevice::BaseDevice()
 INDI::BaseDevice::~BaseDevice()
 {
     delLilXML (lp);
+    pIndex.clear();
     while(!pAll.empty()) { delete pAll.back(), pAll.pop_back(); }
     messageLog.clear();
 
@@ -105,347 +108,96 @@ IBLOBVectorProperty * INDI::BaseDevice::getBLOB(const char *name)
 
 IPState INDI::BaseDevice::getPropertyState(const char *name)
 {
-    IPState state = IPS_IDLE;
-    INDI_PROPERTY_TYPE pType;
-    void *pPtr;
-
-    INumberVectorProperty *nvp;
-    ITextVectorProperty *tvp;
-    ISwitchVectorProperty *svp;
-    ILightVectorProperty *lvp;
-    IBLOBVectorProperty *bvp;
+    INDI::Property *pp = findProperty(name, INDI_UNKNOWN);
 
-    std::vector<INDI::Property *>::iterator orderi = pAll.begin();
+    if (pp == NULL)
+        return IPS_IDLE;
 
-    for (; orderi != pAll.end(); ++orderi)
-    {
-        pType       = (*orderi)->getType();
-        pPtr        = (*orderi)->getProperty();
+    return pp->getState();
+}
 
-        switch (pType)
-        {
-        case INDI_NUMBER:
-            nvp = static_cast<INumberVectorProperty *>(pPtr);
-            if (nvp == NULL)
-                continue;
-            if (!strcmp(name, nvp->name))
-                return nvp->s;
-            break;
-        case INDI_SWITCH:
-            svp = static_cast<ISwitchVectorProperty *>(pPtr);
-            if (svp == NULL)
-                continue;
-            if (!strcmp(name, svp->name))
-                return svp->s;
-            break;
-        case INDI_TEXT:
-            tvp = static_cast<ITextVectorProperty *>(pPtr);
-            if (tvp == NULL)
-                continue;
-            if (!strcmp(name, tvp->name))
-                return tvp->s;
-            break;
-        case INDI_LIGHT:
-            lvp = static_cast<ILightVectorProperty *>(pPtr);
-            if (lvp == NULL)
-                continue;
-            if (!strcmp(name, lvp->name))
-                return lvp->s;
-            break;
-        case INDI_BLOB:
-            bvp = static_cast<IBLOBVectorProperty *>(pPtr);
-            if (bvp == NULL)
-                continue;
-            if (!strcmp(name, bvp->name))
-                return bvp->s;
-            break;
-         default:
-            break;
-        }
-    }
+IPerm INDI::BaseDevice::getPropertyPermission(const char *name)
+{
+    INDI::Property *pp = findProperty(name, INDI_UNKNOWN);
 
-    return state;
+    if (pp == NULL)
+        return IP_RO;
 
+    return pp->getPermission();
 }
 
-IPerm INDI::BaseDevice::getPropertyPermission(const char *name)
+void * INDI::BaseDevice::getRawProperty(const char *name, INDI_PROPERTY_TYPE type)
 {
-    IPerm perm = IP_RO;
+    INDI::Property *pp = getProperty(name, type);
 
-    INDI_PROPERTY_TYPE pType;
-    void *pPtr;
+    if (pp == NULL)
+        return NULL;
 
-    INumberVectorProperty *nvp;
-    ITextVectorProperty *tvp;
-    ISwitchVectorProperty *svp;
-    ILightVectorProperty *lvp;
-    IBLOBVectorProperty *bvp;
+    return pp->getProperty();
+}
 
-    std::vector<INDI::Property *>::iterator orderi = pAll.begin();
+INDI::Property * INDI::BaseDevice::getProperty(const char *name, INDI_PROPERTY_TYPE type)
+{
+    std::pair<PropertyIndex::iterator, PropertyIndex::iterator> range = pIndex.equal_range(name);
 
-    for (; orderi != pAll.end(); ++orderi)
+    for (PropertyIndex::iterator it = range.first; it != range.second; ++it)
     {
-        pType       = (*orderi)->getType();
-        pPtr        = (*orderi)->getProperty();
-
-        switch (pType)
-        {
-        case INDI_NUMBER:
-            nvp = static_cast<INumberVectorProperty *>(pPtr);
-            if (nvp == NULL)
-                continue;
-            if (!strcmp(name, nvp->name))
-                return nvp->p;
-            break;
-        case INDI_SWITCH:
-            svp = static_cast<ISwitchVectorProperty *>(pPtr);
-            if (svp == NULL)
-                continue;
-            if (!strcmp(name, svp->name))
-                return svp->p;
-            break;
-        case INDI_TEXT:
-            tvp = static_cast<ITextVectorProperty *>(pPtr);
-            if (tvp == NULL)
-                continue;
-            if (!strcmp(name, tvp->name))
-                return tvp->p;
-            break;
-        case INDI_BLOB:
-            bvp = static_cast<IBLOBVectorProperty *>(pPtr);
-            if (bvp == NULL)
-                continue;
-            if (!strcmp(name, bvp->name))
-                return bvp->p;
-            break;
-         default:
-            break;
-        }
+        if ((type == INDI_UNKNOWN || it->second->getType() == type) && it->second->getRegistered())
+            return it->second;
     }
 
-    return perm;
-
+    return NULL;
 }
 
-void * INDI::BaseDevice::getRawProperty(const char *name, INDI_PROPERTY_TYPE type)
+INDI::Property * INDI::BaseDevice::findProperty(const char *name, INDI_PROPERTY_TYPE type)
 {
-    INDI_PROPERTY_TYPE pType;
-    void *pPtr;
-    bool pRegistered = false;
+    std::pair<PropertyIndex::iterator, PropertyIndex::iterator> range = pIndex.equal_range(name);
 
-    std::vector<INDI::Property *>::iterator orderi = pAll.begin();
-
-    INumberVectorProperty *nvp;
-    ITextVectorProperty *tvp;
-    ISwitchVectorProperty *svp;
-    ILightVectorProperty *lvp;
-    IBLOBVectorProperty *bvp;
-
-    for (; orderi != pAll.end(); ++orderi)
+    for (PropertyIndex::iterator it = range.first; it != range.second; ++it)
     {
-        pType       = (*orderi)->getType();
-        pPtr        = (*orderi)->getProperty();
-        pRegistered = (*orderi)->getRegistered();
-
-        if (type != INDI_UNKNOWN && pType != type)
-            continue;
-
-        switch (pType)
-        {
-        case INDI_NUMBER:
-            nvp = static_cast<INumberVectorProperty *>(pPtr);
-            if (nvp == NULL)
-                continue;
-
-            if (!strcmp(name, nvp->name) && pRegistered)
-                return pPtr;
-             break;
-        case INDI_TEXT:
-             tvp = static_cast<ITextVectorProperty *>(pPtr);
-             if (tvp == NULL)
-                 continue;
-
-             if (!strcmp(name, tvp->name)  && pRegistered)
-                return pPtr;
-             break;
-        case INDI_SWITCH:
-             svp = static_cast<ISwitchVectorProperty *>(pPtr);
-             if (svp == NULL)
-                 continue;
-
-             //IDLog("Switch %s and aux value is now %d\n", svp->name, regStatus );
-             if (!strcmp(name, svp->name) && pRegistered)
-                 return pPtr;
-             break;
-        case INDI_LIGHT:
-             lvp = static_cast<ILightVectorProperty *>(pPtr);
-             if (lvp == NULL)
-                 continue;
-
-             if (!strcmp(name, lvp->name)  && pRegistered)
-                 return pPtr;
-             break;
-        case INDI_BLOB:
-             bvp = static_cast<IBLOBVectorProperty *>(pPtr);
-             if (bvp == NULL)
-                 continue;
-
-             if (!strcmp(name, bvp->name) && pRegistered)
-                 return pPtr;
-             break;
-        }
-
+        if (type == INDI_UNKNOWN || it->second->getType() == type)
+            return it->second;
     }
 
     return NULL;
 }
 
-INDI::Property * INDI::BaseDevice::getProperty(const char *name, INDI_PROPERTY_TYPE type)
+void INDI::BaseDevice::indexProperty(INDI::Property *pp)
 {
-    INDI_PROPERTY_TYPE pType;
-    void *pPtr;
-    bool pRegistered = false;
-
-    std::vector<INDI::Property *>::iterator orderi;
-
-    INumberVectorProperty *nvp;
-    ITextVectorProperty *tvp;
-    ISwitchVectorProperty *svp;
-    ILightVectorProperty *lvp;
-    IBLOBVectorProperty *bvp;
-
-    for (orderi = pAll.begin(); orderi != pAll.end(); ++orderi)
-    {
-        pType       = (*orderi)->getType();
-        pPtr        = (*orderi)->getProperty();
-        pRegistered = (*orderi)->getRegistered();
-
-        if (type != INDI_UNKNOWN && pType != type)
-            continue;
+    pAll.push_back(pp);
+    pIndex.insert(PropertyIndex::value_type(pp->getName(), pp));
+}
 
-        switch (pType)
-        {
-        case INDI_NUMBER:
-            nvp = static_cast<INumberVectorProperty *>(pPtr);
-            if (nvp == NULL)
-                continue;
+/* FNV-1a */
+size_t INDI::BaseDevice::NameHash::operator()(const char *name) const
+{
+    size_t h = 2166136261u;
 
-            if (!strcmp(name, nvp->name) && pRegistered)
-                return *orderi;
-             break;
-        case INDI_TEXT:
-             tvp = static_cast<ITextVectorProperty *>(pPtr);
-             if (tvp == NULL)
-                 continue;
-
-             if (!strcmp(name, tvp->name)  && pRegistered)
-                return *orderi;
-             break;
-        case INDI_SWITCH:
-             svp = static_cast<ISwitchVectorProperty *>(pPtr);
-             if (svp == NULL)
-                 continue;
-
-             //IDLog("Switch %s and aux value is now %d\n", svp->name, regStatus );
-             if (!strcmp(name, svp->name) && pRegistered)
-                 return *orderi;
-             break;
-        case INDI_LIGHT:
-             lvp = static_cast<ILightVectorProperty *>(pPtr);
-             if (lvp == NULL)
-                 continue;
-
-             if (!strcmp(name, lvp->name)  && pRegistered)
-                 return *orderi;
-             break;
-        case INDI_BLOB:
-             bvp = static_cast<IBLOBVectorProperty *>(pPtr);
-             if (bvp == NULL)
-                 continue;
-
-             if (!strcmp(name, bvp->name) && pRegistered)
-                 return *orderi;
-             break;
-        }
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
 
-    }
+    return h;
+}
 
-    return NULL;
+bool INDI::BaseDevice::NameEqual::operator()(const char *a, const char *b) const
+{
+    return strcmp(a, b) == 0;
 }
 
 int INDI::BaseDevice::removeProperty(const char *name, char *errmsg)
 {    
-    std::vector<INDI::Property *>::iterator orderi;
-
-    INDI_PROPERTY_TYPE pType;
-    void *pPtr;
-
-    INumberVectorProperty *nvp;
-    ITextVectorProperty *tvp;
-    ISwitchVectorProperty *svp;
-    ILightVectorProperty *lvp;
-    IBLOBVectorProperty *bvp;
+    std::pair<PropertyIndex::iterator, PropertyIndex::iterator> range = pIndex.equal_range(name);
 
-    for (orderi = pAll.begin(); orderi != pAll.end(); ++orderi)
+    if (range.first != range.second)
     {
-        pType       = (*orderi)->getType();
-        pPtr        = (*orderi)->getProperty();
+        INDI::Property *pp = range.first->second;
 
-        switch (pType)
-        {
-        case INDI_NUMBER:
-            nvp = static_cast<INumberVectorProperty *>(pPtr);
-            if (!strcmp(name, nvp->name))
-            {
-                (*orderi)->setRegistered(false);
-                delete *orderi;
-                orderi = pAll.erase(orderi);
+        pIndex.erase(range.first);
+        pAll.erase(std::find(pAll.begin(), pAll.end(), pp));
 
-                 return 0;
-             }
-             break;
-        case INDI_TEXT:
-             tvp = static_cast<ITextVectorProperty *>(pPtr);
-             if (!strcmp(name, tvp->name))
-             {
-                  (*orderi)->setRegistered(false);
-                 delete *orderi;
-                 orderi = pAll.erase(orderi);
-
-                  return 0;
-              }
-             break;
-        case INDI_SWITCH:
-             svp = static_cast<ISwitchVectorProperty *>(pPtr);
-             if (!strcmp(name, svp->name))
-             {
-                 (*orderi)->setRegistered(false);
-                 delete *orderi;
-                 orderi = pAll.erase(orderi);
-                  return 0;
-              }
-             break;
-        case INDI_LIGHT:
-             lvp = static_cast<ILightVectorProperty *>(pPtr);
-             if (!strcmp(name, lvp->name))
-             {
-                 (*orderi)->setRegistered(false);
-                 delete *orderi;
-                 orderi = pAll.erase(orderi);
-                 return 0;
-              }
-             break;
-        case INDI_BLOB:
-             bvp = static_cast<IBLOBVectorProperty *>(pPtr);
-             if (!strcmp(name, bvp->name))
-             {
-                 (*orderi)->setRegistered(false);
-                 delete *orderi;
-                 orderi = pAll.erase(orderi);
-                 return 0;
-              }
-             break;
-        }
+        pp->setRegistered(false);
+        delete pp;
+        return 0;
     }
 
     snprintf(errmsg, MAXRBUF, "Error: Property %s not found in device %s.", name, deviceID);
@@ -620,7 +372,7 @@ int INDI::BaseDevice::buildProp(XMLEle *root, char *errmsg)
         indiProp->setDynamic(true);
         indiProp->setType(INDI_NUMBER);
 
-        pAll.push_back(indiProp);
+        indexProperty(indiProp);
 
         //IDLog("Adding number property %s to list.\n", nvp->name);
         if (mediator)
@@ -685,7 +437,7 @@ int INDI::BaseDevice::buildProp(XMLEle *root, char *errmsg)
             indiProp->setDynamic(true);
             indiProp->setType(INDI_SWITCH);
 
-            pAll.push_back(indiProp);
+            indexProperty(indiProp);
             //IDLog("Adding Switch property %s to list.\n", svp->name);
             if (mediator)
                 mediator->newProperty(indiProp);
@@ -746,7 +498,7 @@ else if (!strcmp (rtag, "defTextVector"))
         indiProp->setDynamic(true);
         indiProp->setType(INDI_TEXT);
 
-        pAll.push_back(indiProp);
+        indexProperty(indiProp);
 
         //IDLog("Adding Text property %s to list with initial value of %s.\n", tvp->name, tvp->tp[0].text);
         if (mediator)
@@ -804,7 +556,7 @@ else if (!strcmp (rtag, "defLightVector"))
         indiProp->setDynamic(true);
         indiProp->setType(INDI_LIGHT);
 
-        pAll.push_back(indiProp);
+        indexProperty(indiProp);
 
         //IDLog("Adding Light property %s to list.\n", lvp->name);
         if (mediator)
@@ -871,7 +623,7 @@ else if (!strcmp (rtag, "defBLOBVector"))
         indiProp->setDynamic(true);
         indiProp->setType(INDI_BLOB);
 
-        pAll.push_back(indiProp);
+        indexProperty(indiProp);
         //IDLog("Adding BLOB property %s to list.\n", bvp->name);
         if (mediator)
             mediator->newProperty(indiProp);
@@ -905,7 +657,7 @@ bool INDI::BaseDevice::isConnected()
 /*
  * return 0 if ok else -1 with reason in errmsg
  */
-int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
+int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg, const unsigned char *attached)
 {
     XMLAtt *ap;
     XMLEle *ep;
@@ -955,7 +707,8 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
 
     if (!strcmp(rtag, "setNumberVector"))
     {
-        INumberVectorProperty *nvp = getNumber(name);
+        INDI::Property *pp = getProperty(name, INDI_NUMBER);
+        INumberVectorProperty *nvp = pp ? pp->getNumber() : NULL;
         if (nvp == NULL)
         {
             snprintf(errmsg, MAXRBUF, "INDI: Could not find property %s in %s", name, deviceID);
@@ -972,7 +725,10 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
         
        for (ep = nextXMLEle (root, 1); ep != NULL; ep = nextXMLEle (root, 0))
         {
-           INumber *np =  IUFindNumber(nvp, findXMLAttValu(ep, "name"));
+           const char *ename = findXMLAttValu(ep, "name");
+           int i = pp->findElement(ename);
+           // IUFindNumber() reports an element that is not there
+           INumber *np = (i >= 0) ? &nvp->np[i] : IUFindNumber(nvp, ename);
            if (!np)
                continue;
 
@@ -994,7 +750,8 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
     }
     else if (!strcmp(rtag, "setTextVector"))
     {
-        ITextVectorProperty *tvp = getText(name);
+        INDI::Property *pp = getProperty(name, INDI_TEXT);
+        ITextVectorProperty *tvp = pp ? pp->getText() : NULL;
         if (tvp == NULL)
             return -1;
 
@@ -1006,7 +763,10 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
 
        for (ep = nextXMLEle (root, 1); ep != NULL; ep = nextXMLEle (root, 0))
         {
-           IText *tp =  IUFindText(tvp, findXMLAttValu(ep, "name"));
+           const char *ename = findXMLAttValu(ep, "name");
+           int i = pp->findElement(ename);
+           // IUFindText() reports an element that is not there
+           IText *tp = (i >= 0) ? &tvp->tp[i] : IUFindText(tvp, ename);
            if (!tp)
                continue;
 
@@ -1021,7 +781,8 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
     else if (!strcmp(rtag, "setSwitchVector"))
     {
         ISState swState;
-        ISwitchVectorProperty *svp = getSwitch(name);
+        INDI::Property *pp = getProperty(name, INDI_SWITCH);
+        ISwitchVectorProperty *svp = pp ? pp->getSwitch() : NULL;
         if (svp == NULL)
             return -1;
 
@@ -1033,7 +794,10 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
 
        for (ep = nextXMLEle (root, 1); ep != NULL; ep = nextXMLEle (root, 0))
         {
-           ISwitch *sp =  IUFindSwitch(svp, findXMLAttValu(ep, "name"));
+           const char *ename = findXMLAttValu(ep, "name");
+           int i = pp->findElement(ename);
+           // IUFindSwitch() reports an element that is not there
+           ISwitch *sp = (i >= 0) ? &svp->sp[i] : IUFindSwitch(svp, ename);
            if (!sp)
                continue;
 
@@ -1049,7 +813,8 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
     else if (!strcmp(rtag, "setLightVector"))
     {
         IPState lState;
-        ILightVectorProperty *lvp = getLight(name);
+        INDI::Property *pp = getProperty(name, INDI_LIGHT);
+        ILightVectorProperty *lvp = pp ? pp->getLight() : NULL;
         if (lvp == NULL)
             return -1;
 
@@ -1058,7 +823,10 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
 
        for (ep = nextXMLEle (root, 1); ep != NULL; ep = nextXMLEle (root, 0))
         {
-           ILight *lp =  IUFindLight(lvp, findXMLAttValu(ep, "name"));
+           const char *ename = findXMLAttValu(ep, "name");
+           int i = pp->findElement(ename);
+           // IUFindLight() reports an element that is not there
+           ILight *lp = (i >= 0) ? &lvp->lp[i] : IUFindLight(lvp, ename);
            if (!lp)
                continue;
 
@@ -1084,7 +852,7 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
         if (timeoutSet)
             bvp->timeout = timeout;
 
-        return setBLOB(bvp, root, errmsg);
+        return setBLOB(bvp, root, errmsg, attached);
     }
 
     snprintf(errmsg, MAXRBUF, "INDI: <%s> Unable to process tag", tagXMLEle(root));
@@ -1094,7 +862,7 @@ int INDI::BaseDevice::setValue (XMLEle *root, char * errmsg)
 /* Set BLOB vector. Process incoming data stream
  * Return 0 if okay, -1 if error
 */
-int INDI::BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle * root, char * errmsg)
+int INDI::BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle * root, char * errmsg, const unsigned char *attached)
 {   
     IBLOB *blobEL;
     unsigned char * dataBuffer=NULL;
@@ -1109,6 +877,23 @@ int INDI::BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle * root, char * er
         {
             XMLAtt *na = findXMLAtt (ep, "name");
 
+            /* already handed to a sink as it arrived, see BaseClient::setBLOBSink(),
+             * just notify unless it was dropped */
+            XMLAtt *st = findXMLAtt (ep, "streamed");
+            if (st)
+            {
+                blobEL = IUFindBLOB(bvp, findXMLAttValu (ep, "name"));
+                if (blobEL && atoi(valuXMLAtt(st)) >= 0 && mediator)
+                    mediator->newBLOB(blobEL);
+                continue;
+            }
+
+            /* raw bytes of this BLOB, if sent binary */
+            XMLAtt *aa = findXMLAtt (ep, "attached");
+            const unsigned char *raw = (aa && attached) ? attached : NULL;
+            if (raw)
+                attached += atoi(valuXMLAtt(aa));
+
             blobEL = IUFindBLOB(bvp, findXMLAttValu (ep, "name"));
 
             XMLAtt *fa = findXMLAtt (ep, "format");
@@ -1126,13 +911,24 @@ int INDI::BaseDevice::setBLOB(IBLOBVectorProperty *bvp, XMLEle * root, char * er
                     continue;
                 }
 
-                 blobEL->blob = (unsigned char *) realloc (blobEL->blob, 3*pcdatalenXMLEle(ep)/4);
+                 if (raw)
+                 {
+                     blobEL->bloblen = atoi(valuXMLAtt(aa));
+                     blobEL->blob = (unsigned char *) realloc (blobEL->blob, blobEL->bloblen);
+                     memcpy(blobEL->blob, raw, blobEL->bloblen);
+                 }
+                 else
+                 {
+                     blobEL->blob = (unsigned char *) realloc (blobEL->blob, 3*pcdatalenXMLEle(ep)/4);
 
-                 blobEL->bloblen = from64tobits( static_cast<char *> (blobEL->blob), pcdataXMLEle(ep));
+                     blobEL->bloblen = from64tobits_fast( static_cast<char *> (blobEL->blob), pcdataXMLEle(ep), pcdatalenXMLEle(ep));
+                 }
 
                  strncpy(blobEL->format, valuXMLAtt(fa), MAXINDIFORMAT);
 
-                    if (strstr(blobEL->format, ".z"))
+                    /* zlib compressed, format ends in .z */
+                    size_t fmtlen = strlen(blobEL->format);
+                    if (fmtlen > 2 && strcmp(blobEL->format + fmtlen - 2, ".z") == 0)
                     {
                         blobEL->format[strlen(blobEL->format)-2] = '\0';
                         dataSize = blobEL->size * sizeof(unsigned char);
@@ -1262,7 +1058,7 @@ void INDI::BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
         pContainer->setProperty(p);
         pContainer->setType(type);
 
-        pAll.push_back(pContainer);
+        indexProperty(pContainer);
 
     }
     else if (type == INDI_TEXT)
@@ -1279,7 +1075,7 @@ void INDI::BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
        pContainer->setProperty(p);
        pContainer->setType(type);
 
-       pAll.push_back(pContainer);
+       indexProperty(pContainer);
 
 
    }
@@ -1297,7 +1093,7 @@ void INDI::BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
        pContainer->setProperty(p);
        pContainer->setType(type);
 
-       pAll.push_back(pContainer);
+       indexProperty(pContainer);
 
     }
     else if (type == INDI_LIGHT)
@@ -1314,7 +1110,7 @@ void INDI::BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
        pContainer->setProperty(p);
        pContainer->setType(type);
 
-       pAll.push_back(pContainer);
+       indexProperty(pContainer);
    }
     else if (type == INDI_BLOB)
     {
@@ -1330,7 +1126,7 @@ void INDI::BaseDevice::registerProperty(void *p, INDI_PROPERTY_TYPE type)
        pContainer->setProperty(p);
        pContainer->setType(type);
 
-       pAll.push_back(pContainer);
+       indexProperty(pContainer);
 
     }
 
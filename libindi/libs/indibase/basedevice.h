@@ -21,6 +21,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include <locale.h>
 #include <pthread.h>
@@ -198,16 +199,41 @@ protected:
     int buildProp(XMLEle *root, char *errmsg);
 
     /** \brief handle SetXXX commands from client */
-    int setValue (XMLEle *root, char * errmsg);
-    /** \brief Parse and store BLOB in the respective vector */
-    int setBLOB(IBLOBVectorProperty *pp, XMLEle * root, char * errmsg);
+    int setValue (XMLEle *root, char * errmsg, const unsigned char *attached=NULL);
+    /** \brief Parse and store BLOB in the respective vector.
+        \param attached raw bytes of the oneBLOBs sent with attached='N' instead of base64, in order, or NULL */
+    int setBLOB(IBLOBVectorProperty *pp, XMLEle * root, char * errmsg, const unsigned char *attached=NULL);
 
 private:
 
+    /* property names hashed in place, without copying them to std::string */
+    struct NameHash
+    {
+        size_t operator()(const char *name) const;
+    };
+    struct NameEqual
+    {
+        bool operator()(const char *a, const char *b) const;
+    };
+    typedef std::unordered_multimap<const char *, INDI::Property *, NameHash, NameEqual> PropertyIndex;
+
+    /** \brief Add a property to pAll and to the name index. */
+    void indexProperty(INDI::Property *pp);
+
+    /** \brief Return the property called name from the name index, registered or not.
+        \param name name of property to be found.
+        \param type type of property to be found, or INDI_UNKNOWN for any type.
+        \return the property, or NULL if there is none.
+    */
+    INDI::Property * findProperty(const char *name, INDI_PROPERTY_TYPE type);
+
     char *deviceID;
 
     std::vector<INDI::Property *> pAll;
 
+    /* each property of pAll by name, keyed by the name in the property itself */
+    PropertyIndex pIndex;
+
     LilXML *lp;
 
     std::vector<std::string> messageLog;
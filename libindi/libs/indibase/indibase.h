@@ -44,6 +44,8 @@ namespace INDI
 {
     class BaseMediator;
     class BaseClient;
+    class BLOBSink;
+    class FileBLOBSink;
     class BaseDevice;
     class DefaultDevice;
     class FilterInterface;
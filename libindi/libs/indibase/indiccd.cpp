@@ -23,6 +23,7 @@
 *******************************************************************************/
 
 #include "indiccd.h"
+#include "indiccdimage.h"
 
 #include <string.h>
 #include <time.h>
@@ -48,6 +49,9 @@ const char *GUIDE_CONTROL_TAB   = "Guider Control";
 const char *RAPIDGUIDE_TAB      = "Rapid Guide";
 const char *WCS_TAB             = "WCS";
 
+// Images queued for the upload thread, besides the one it is uploading
+const unsigned int UPLOAD_QUEUE_DEPTH = 2;
+
 // Create dir recursively
 static int _mkdir(const char *dir, mode_t mode)
 {
@@ -91,6 +95,7 @@ CCDChip::CCDChip()
 
     FrameType=LIGHT_FRAME;
     lastRapidX = lastRapidY = -1;
+    ImageStatsValid = false;
 }
 
 CCDChip::~CCDChip()
@@ -279,73 +284,23 @@ void CCDChip::setImageExtension(const char *ext)
 
 void CCDChip::binFrame()
 {
-    if (BinX == 1)
+    if (BinX == 1 && BinY == 1)
         return;
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
     if (BinFrame == NULL)
         BinFrame = (uint8_t*) malloc(RawFrameSize);
 
-    memset(BinFrame, 0, RawFrameSize);
-
-    switch (getBPP())
-    {
-    case 8:
-    {
-        uint8_t *bin_buf = BinFrame;
-        uint8_t val;
-        for (int i=0; i < SubH; i+= BinX)
-            for (int j=0; j < SubW; j+= BinX)
-            {
-                for (int k=0; k < BinX; k++)
-                {
-                    for (int l=0; l < BinX; l++)
-                    {
-                        val = *(RawFrame + j + (i+k) * SubW + l);
-                        if (val + *bin_buf > UINT8_MAX)
-                            *bin_buf = UINT8_MAX;
-                        else
-                            *bin_buf  += val;
-                    }
-                }
-                bin_buf++;
-            }
-    }
-    break;
-
-    case 16:
-    {
-        uint16_t *bin_buf = (uint16_t*) BinFrame;
-        uint16_t *RawFrame16 = (uint16_t*) RawFrame;
-        uint16_t val;
-        for (int i=0; i < SubH; i+= BinX)
-            for (int j=0; j < SubW; j+= BinX)
-            {
-                for (int k=0; k < BinX; k++)
-                {
-                    for (int l=0; l < BinX; l++)
-                    {
-                        val = *(RawFrame16 + j + (i+k) * SubW + l);
-                        if (val + *bin_buf > UINT16_MAX)
-                            *bin_buf = UINT16_MAX;
-                        else
-                            *bin_buf  += val;
-                    }
-                }
-                bin_buf++;
-            }
-    }
-    break;
-
-    default:
+    if (BinFrame == NULL)
         return;
 
-    }
+    // Every binned pixel is written, so BinFrame needs no clearing first
+    if (binPixels(BinFrame, RawFrame, SubW, SubH, BinX, BinY, getBPP()) == false)
+        return;
 
     // Swap frame pointers
     uint8_t *rawFramePointer = RawFrame;
     RawFrame = BinFrame;
-    // We just memset it next time we use it
     BinFrame = rawFramePointer;
 }
 
@@ -376,10 +331,29 @@ INDI::CCD::CCD()
     Aperture=FocalLength=-1;
 
     streamer = NULL;
+
+    pthread_mutex_init(&uploadQueueLock, NULL);
+    pthread_cond_init(&uploadQueueCond, NULL);
+    pthread_mutex_init(&uploadLock, NULL);
+    uploadRunning = false;
+    uploadStop = false;
 }
 
 INDI::CCD::~CCD()
 {
+    // Let the upload thread finish what is queued
+    pthread_mutex_lock(&uploadQueueLock);
+    uploadStop = true;
+    pthread_cond_broadcast(&uploadQueueCond);
+    bool running = uploadRunning;
+    pthread_mutex_unlock(&uploadQueueLock);
+    if (running)
+        pthread_join(uploadTID, NULL);
+
+    pthread_mutex_destroy(&uploadQueueLock);
+    pthread_cond_destroy(&uploadQueueCond);
+    pthread_mutex_destroy(&uploadLock);
+
     delete (streamer);
 }
 
@@ -448,6 +422,14 @@ bool INDI::CCD::initProperties()
     IUFillSwitchVector(&PrimaryCCD.CompressSP,PrimaryCCD.CompressS,2,getDeviceName(),"CCD_COMPRESSION","Image",IMAGE_SETTINGS_TAB,IP_RW,ISR_1OFMANY,60,IPS_IDLE);
     PrimaryCCD.SendCompressed = false;
 
+    IUFillNumber(&PrimaryCCD.CompressLevelN[0],"LEVEL","Level (1 fast, 9 small)","%.f",1,9,1,6);
+    IUFillNumberVector(&PrimaryCCD.CompressLevelNP,PrimaryCCD.CompressLevelN,1,getDeviceName(),"CCD_COMPRESSION_LEVEL","Compression",IMAGE_SETTINGS_TAB,IP_RW,60,IPS_IDLE);
+
+    IUFillSwitch(&PrimaryCCD.TileCompressS[0],"TILE_NONE","None",ISS_ON);
+    IUFillSwitch(&PrimaryCCD.TileCompressS[1],"TILE_RICE","Rice",ISS_OFF);
+    IUFillSwitch(&PrimaryCCD.TileCompressS[2],"TILE_HCOMPRESS","HCompress",ISS_OFF);
+    IUFillSwitchVector(&PrimaryCCD.TileCompressSP,PrimaryCCD.TileCompressS,3,getDeviceName(),"CCD_TILE_COMPRESSION","FITS Tiles",IMAGE_SETTINGS_TAB,IP_RW,ISR_1OFMANY,60,IPS_IDLE);
+
     IUFillBLOB(&PrimaryCCD.FitsB,"CCD1","Image","");
     IUFillBLOBVector(&PrimaryCCD.FitsBP,&PrimaryCCD.FitsB,1,getDeviceName(),"CCD1","Image Data",IMAGE_INFO_TAB,IP_RO,60,IPS_IDLE);
 
@@ -465,6 +447,19 @@ bool INDI::CCD::initProperties()
     IUFillNumber(&PrimaryCCD.RapidGuideDataN[2],"GUIDESTAR_FIT","Guide star fit","%5.2f",0,1024,0,0);
     IUFillNumberVector(&PrimaryCCD.RapidGuideDataNP,PrimaryCCD.RapidGuideDataN,3,getDeviceName(),"CCD_RAPID_GUIDE_DATA","Rapid Guide Data",RAPIDGUIDE_TAB,IP_RO,60,IPS_IDLE);
 
+    IUFillSwitch(&PrimaryCCD.ImageStatsS[0], "ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&PrimaryCCD.ImageStatsS[1], "DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&PrimaryCCD.ImageStatsSP, PrimaryCCD.ImageStatsS, 2, getDeviceName(), "CCD_STATISTICS", "Statistics", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&PrimaryCCD.ImageStatsN[0],"STATS_MIN","Minimum","%.f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[1],"STATS_MAX","Maximum","%.f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[2],"STATS_MEAN","Mean","%.2f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[3],"STATS_STDDEV","Standard deviation","%.2f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[4],"STATS_MEDIAN","Median","%.f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[5],"STATS_P01","1st percentile","%.f",0,0,0,0);
+    IUFillNumber(&PrimaryCCD.ImageStatsN[6],"STATS_P99","99th percentile","%.f",0,0,0,0);
+    IUFillNumberVector(&PrimaryCCD.ImageStatsNP,PrimaryCCD.ImageStatsN,7,getDeviceName(),"CCD_STATISTICS_DATA","Statistics Data",IMAGE_INFO_TAB,IP_RO,60,IPS_IDLE);
+
     // Reset Frame Settings
     IUFillSwitch(&PrimaryCCD.ResetS[0], "RESET", "Reset", ISS_OFF);
     IUFillSwitchVector(&PrimaryCCD.ResetSP, PrimaryCCD.ResetS, 1, getDeviceName(), "CCD_FRAME_RESET", "Frame Values", IMAGE_SETTINGS_TAB, IP_WO, ISR_1OFMANY, 0, IPS_IDLE);
@@ -506,6 +501,14 @@ bool INDI::CCD::initProperties()
     IUFillSwitchVector(&GuideCCD.CompressSP,GuideCCD.CompressS,2,getDeviceName(),"GUIDER_COMPRESSION","Image",GUIDE_HEAD_TAB,IP_RW,ISR_1OFMANY,60,IPS_IDLE);
     GuideCCD.SendCompressed = false;
 
+    IUFillNumber(&GuideCCD.CompressLevelN[0],"LEVEL","Level (1 fast, 9 small)","%.f",1,9,1,6);
+    IUFillNumberVector(&GuideCCD.CompressLevelNP,GuideCCD.CompressLevelN,1,getDeviceName(),"GUIDER_COMPRESSION_LEVEL","Compression",GUIDE_HEAD_TAB,IP_RW,60,IPS_IDLE);
+
+    IUFillSwitch(&GuideCCD.TileCompressS[0],"TILE_NONE","None",ISS_ON);
+    IUFillSwitch(&GuideCCD.TileCompressS[1],"TILE_RICE","Rice",ISS_OFF);
+    IUFillSwitch(&GuideCCD.TileCompressS[2],"TILE_HCOMPRESS","HCompress",ISS_OFF);
+    IUFillSwitchVector(&GuideCCD.TileCompressSP,GuideCCD.TileCompressS,3,getDeviceName(),"GUIDER_TILE_COMPRESSION","FITS Tiles",GUIDE_HEAD_TAB,IP_RW,ISR_1OFMANY,60,IPS_IDLE);
+
     IUFillBLOB(&GuideCCD.FitsB,"CCD2","Guider Image","");
     IUFillBLOBVector(&GuideCCD.FitsBP,&GuideCCD.FitsB,1,getDeviceName(),"CCD2","Image Data",IMAGE_INFO_TAB,IP_RO,60,IPS_IDLE);
 
@@ -523,6 +526,19 @@ bool INDI::CCD::initProperties()
     IUFillNumber(&GuideCCD.RapidGuideDataN[2],"GUIDESTAR_FIT","Guide star fit","%5.2f",0,1024,0,0);
     IUFillNumberVector(&GuideCCD.RapidGuideDataNP,GuideCCD.RapidGuideDataN,3,getDeviceName(),"GUIDER_RAPID_GUIDE_DATA","Rapid Guide Data",RAPIDGUIDE_TAB,IP_RO,60,IPS_IDLE);
 
+    IUFillSwitch(&GuideCCD.ImageStatsS[0], "ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&GuideCCD.ImageStatsS[1], "DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&GuideCCD.ImageStatsSP, GuideCCD.ImageStatsS, 2, getDeviceName(), "GUIDER_STATISTICS", "Guider Head Statistics", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+    IUFillNumber(&GuideCCD.ImageStatsN[0],"STATS_MIN","Minimum","%.f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[1],"STATS_MAX","Maximum","%.f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[2],"STATS_MEAN","Mean","%.2f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[3],"STATS_STDDEV","Standard deviation","%.2f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[4],"STATS_MEDIAN","Median","%.f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[5],"STATS_P01","1st percentile","%.f",0,0,0,0);
+    IUFillNumber(&GuideCCD.ImageStatsN[6],"STATS_P99","99th percentile","%.f",0,0,0,0);
+    IUFillNumberVector(&GuideCCD.ImageStatsNP,GuideCCD.ImageStatsN,7,getDeviceName(),"GUIDER_STATISTICS_DATA","Guider Head Statistics Data",IMAGE_INFO_TAB,IP_RO,60,IPS_IDLE);
+
     // CCD Class Init    
 
     IUFillText(&BayerT[0],"CFA_OFFSET_X","X Offset","0");
@@ -539,6 +555,10 @@ bool INDI::CCD::initProperties()
     IUFillText(&UploadSettingsT[1],"UPLOAD_PREFIX","Prefix","IMAGE_XXX");
     IUFillTextVector(&UploadSettingsTP,UploadSettingsT,2,getDeviceName(),"UPLOAD_SETTINGS","Upload Settings",OPTIONS_TAB,IP_RW,60,IPS_IDLE);
 
+    IUFillSwitch(&UploadAsyncS[0], "ASYNC_ENABLE", "Enable", ISS_OFF);
+    IUFillSwitch(&UploadAsyncS[1], "ASYNC_DISABLE", "Disable", ISS_ON);
+    IUFillSwitchVector(&UploadAsyncSP, UploadAsyncS, 2, getDeviceName(), "UPLOAD_ASYNC", "Async Upload", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
     IUFillText(&FileNameT[0],"FILE_PATH","Path","");
     IUFillTextVector(&FileNameTP,FileNameT,1,getDeviceName(),"CCD_FILE_PATH","Filename",IMAGE_INFO_TAB,IP_RO,60,IPS_IDLE);
 
@@ -628,10 +648,14 @@ bool INDI::CCD::updateProperties()
                 defineNumber(&GuideCCD.ImageBinNP);
         }
         defineSwitch(&PrimaryCCD.CompressSP);
+        defineNumber(&PrimaryCCD.CompressLevelNP);
+        defineSwitch(&PrimaryCCD.TileCompressSP);
         defineBLOB(&PrimaryCCD.FitsBP);
         if(HasGuideHead())
         {
             defineSwitch(&GuideCCD.CompressSP);
+            defineNumber(&GuideCCD.CompressLevelNP);
+            defineSwitch(&GuideCCD.TileCompressSP);
             defineBLOB(&GuideCCD.FitsBP);
         }
         if(HasST4Port())
@@ -665,12 +689,23 @@ bool INDI::CCD::updateProperties()
           defineSwitch(&GuideCCD.RapidGuideSetupSP);
           defineNumber(&GuideCCD.RapidGuideDataNP);
         }        
+
+        defineSwitch(&PrimaryCCD.ImageStatsSP);
+        if (PrimaryCCD.ImageStatsS[0].s == ISS_ON)
+            defineNumber(&PrimaryCCD.ImageStatsNP);
+        if (HasGuideHead())
+        {
+            defineSwitch(&GuideCCD.ImageStatsSP);
+            if (GuideCCD.ImageStatsS[0].s == ISS_ON)
+                defineNumber(&GuideCCD.ImageStatsNP);
+        }
         defineSwitch(&WorldCoordSP);
         defineSwitch(&UploadSP);
 
         if (UploadSettingsT[0].text == NULL)
             IUSaveText(&UploadSettingsT[0], getenv("HOME"));
         defineText(&UploadSettingsTP);                
+        defineSwitch(&UploadAsyncSP);
     }
     else
     {
@@ -685,12 +720,17 @@ bool INDI::CCD::updateProperties()
             deleteProperty(PrimaryCCD.AbortExposureSP.name);
         deleteProperty(PrimaryCCD.FitsBP.name);
         deleteProperty(PrimaryCCD.CompressSP.name);
+        deleteProperty(PrimaryCCD.CompressLevelNP.name);
+        deleteProperty(PrimaryCCD.TileCompressSP.name);
         deleteProperty(PrimaryCCD.RapidGuideSP.name);
         if (RapidGuideEnabled)
         {
           deleteProperty(PrimaryCCD.RapidGuideSetupSP.name);
           deleteProperty(PrimaryCCD.RapidGuideDataNP.name);
         }
+        deleteProperty(PrimaryCCD.ImageStatsSP.name);
+        if (PrimaryCCD.ImageStatsS[0].s == ISS_ON)
+            deleteProperty(PrimaryCCD.ImageStatsNP.name);
         if(HasGuideHead())
         {
             deleteProperty(GuideCCD.ImageExposureNP.name);
@@ -703,6 +743,8 @@ bool INDI::CCD::updateProperties()
             if (CanBin())
                 deleteProperty(GuideCCD.ImageBinNP.name);
             deleteProperty(GuideCCD.CompressSP.name);
+            deleteProperty(GuideCCD.CompressLevelNP.name);
+            deleteProperty(GuideCCD.TileCompressSP.name);
             deleteProperty(GuideCCD.FrameTypeSP.name);
             deleteProperty(GuideCCD.RapidGuideSP.name);
             if (GuiderRapidGuideEnabled)
@@ -710,6 +752,9 @@ bool INDI::CCD::updateProperties()
               deleteProperty(GuideCCD.RapidGuideSetupSP.name);
               deleteProperty(GuideCCD.RapidGuideDataNP.name);
             }
+            deleteProperty(GuideCCD.ImageStatsSP.name);
+            if (GuideCCD.ImageStatsS[0].s == ISS_ON)
+                deleteProperty(GuideCCD.ImageStatsNP.name);
         }
         if (HasCooler())
             deleteProperty(TemperatureNP.name);
@@ -731,6 +776,7 @@ bool INDI::CCD::updateProperties()
         deleteProperty(WorldCoordSP.name);
         deleteProperty(UploadSP.name);
         deleteProperty(UploadSettingsTP.name);
+        deleteProperty(UploadAsyncSP.name);
     }
 
     // Streamer
@@ -844,7 +890,10 @@ bool INDI::CCD::ISNewText (const char *dev, const char *name, char *texts[], cha
 
         if (!strcmp(name, UploadSettingsTP.name))
         {
+            // The upload thread may be reading them
+            pthread_mutex_lock(&uploadLock);
             IUUpdateText(&UploadSettingsTP, texts, names, n);
+            pthread_mutex_unlock(&uploadLock);
             IDSetText(&UploadSettingsTP, NULL);
             return true;
         }
@@ -868,6 +917,16 @@ bool INDI::CCD::ISNewNumber (const char *dev, const char *name, double values[],
     {
         //  This is for our device
         //  Now lets see if it's something we process here
+        if (strcmp(name, PrimaryCCD.CompressLevelNP.name)==0 || strcmp(name, GuideCCD.CompressLevelNP.name)==0)
+        {
+            CCDChip *targetChip = (strcmp(name, PrimaryCCD.CompressLevelNP.name)==0) ? &PrimaryCCD : &GuideCCD;
+
+            IUUpdateNumber(&targetChip->CompressLevelNP, values, names, n);
+            targetChip->CompressLevelNP.s = IPS_OK;
+            IDSetNumber(&targetChip->CompressLevelNP, NULL);
+            return true;
+        }
+
         if(strcmp(name,"CCD_EXPOSURE")==0)
         {
             if (PrimaryCCD.getFrameType() != CCDChip::BIAS_FRAME && values[0] <  PrimaryCCD.ImageExposureN[0].min || values[0] > PrimaryCCD.ImageExposureN[0].max)
@@ -1158,6 +1217,19 @@ bool INDI::CCD::ISNewSwitch (const char *dev, const char *name, ISState *states,
             return true;
         }
 
+        if (!strcmp(name, UploadAsyncSP.name))
+        {
+            IUUpdateSwitch(&UploadAsyncSP, states, names, n);
+            UploadAsyncSP.s = IPS_OK;
+            IDSetSwitch(&UploadAsyncSP, NULL);
+
+            if (UploadAsyncS[0].s == ISS_ON)
+                DEBUG(INDI::Logger::DBG_SESSION, "Images are uploaded in the background while the next exposure runs.");
+            else
+                DEBUG(INDI::Logger::DBG_SESSION, "Images are uploaded before the next exposure.");
+            return true;
+        }
+
         if (!strcmp(name, TelescopeTypeSP.name))
         {
             IUUpdateSwitch(&TelescopeTypeSP, states, names, n);
@@ -1279,6 +1351,16 @@ bool INDI::CCD::ISNewSwitch (const char *dev, const char *name, ISState *states,
             return true;
         }
 
+        if (strcmp(name, PrimaryCCD.TileCompressSP.name)==0 || strcmp(name, GuideCCD.TileCompressSP.name)==0)
+        {
+            CCDChip *targetChip = (strcmp(name, PrimaryCCD.TileCompressSP.name)==0) ? &PrimaryCCD : &GuideCCD;
+
+            IUUpdateSwitch(&targetChip->TileCompressSP, states, names, n);
+            targetChip->TileCompressSP.s = IPS_OK;
+            IDSetSwitch(&targetChip->TileCompressSP, NULL);
+            return true;
+        }
+
         if(strcmp(name,PrimaryCCD.FrameTypeSP.name)==0)
         {
             IUUpdateSwitch(&PrimaryCCD.FrameTypeSP,states,names,n);
@@ -1377,6 +1459,23 @@ bool INDI::CCD::ISNewSwitch (const char *dev, const char *name, ISState *states,
             return true;
         }
 
+        if (strcmp(name, PrimaryCCD.ImageStatsSP.name)==0 || strcmp(name, GuideCCD.ImageStatsSP.name)==0)
+        {
+            CCDChip *targetChip = (strcmp(name, PrimaryCCD.ImageStatsSP.name)==0) ? &PrimaryCCD : &GuideCCD;
+            bool wasEnabled = (targetChip->ImageStatsS[0].s == ISS_ON);
+
+            IUUpdateSwitch(&targetChip->ImageStatsSP, states, names, n);
+            targetChip->ImageStatsSP.s=IPS_OK;
+
+            if (targetChip->ImageStatsS[0].s == ISS_ON && !wasEnabled)
+                defineNumber(&targetChip->ImageStatsNP);
+            else if (targetChip->ImageStatsS[0].s == ISS_OFF && wasEnabled)
+                deleteProperty(targetChip->ImageStatsNP.name);
+
+            IDSetSwitch(&targetChip->ImageStatsSP,NULL);
+            return true;
+        }
+
         if (strcmp(name, PrimaryCCD.RapidGuideSetupSP.name)==0)
         {
             IUUpdateSwitch(&PrimaryCCD.RapidGuideSetupSP, states, names, n);
@@ -1498,7 +1597,12 @@ void INDI::CCD::addFITSKeywords(fitsfile *fptr, CCDChip *targetChip)
 
     char *orig = setlocale(LC_NUMERIC,"C");
 
-    if (targetChip->getNAxis() == 2)
+    if (targetChip->ImageStatsValid)
+    {
+        min_val = targetChip->ImageStatsN[0].value;
+        max_val = targetChip->ImageStatsN[1].value;
+    }
+    else if (targetChip->getNAxis() == 2)
         getMinMax(&min_val, &max_val, targetChip);
 
     xbin = targetChip->getBinX();
@@ -1558,6 +1662,13 @@ void INDI::CCD::addFITSKeywords(fitsfile *fptr, CCDChip *targetChip)
         fits_update_key_s(fptr, TDOUBLE, "DATAMAX", &max_val, "Maximum value", &status);
     }
 
+    if (targetChip->ImageStatsValid)
+    {
+        fits_update_key_s(fptr, TDOUBLE, "DATAMEAN", &(targetChip->ImageStatsN[2].value), "Mean value", &status);
+        fits_update_key_s(fptr, TDOUBLE, "DATASTD", &(targetChip->ImageStatsN[3].value), "Standard deviation", &status);
+        fits_update_key_s(fptr, TDOUBLE, "DATAMED", &(targetChip->ImageStatsN[4].value), "Median value", &status);
+    }
+
     if (HasBayer() && targetChip->getNAxis() == 2)
     {
         unsigned int bayer_offset_x = atoi(BayerT[0].text);
@@ -1669,6 +1780,7 @@ bool INDI::CCD::ExposureComplete(CCDChip *targetChip)
 {
     bool sendImage = (UploadS[0].s == ISS_ON || UploadS[2].s == ISS_ON);
     bool saveImage = (UploadS[1].s == ISS_ON || UploadS[2].s == ISS_ON);
+    bool asyncUpload = (UploadAsyncS[0].s == ISS_ON);
     bool showMarker = false;
     bool autoLoop = false;
     bool sendData = false;
@@ -1918,8 +2030,13 @@ bool INDI::CCD::ExposureComplete(CCDChip *targetChip)
       }
     }
 
+    updateImageStats(targetChip);
+
     if (sendImage || saveImage)
     {
+      // Taken now, the upload may run on the upload thread while these change
+      int compressLevel = targetChip->SendCompressed ? (int) targetChip->CompressLevelN[0].value : 0;
+
       if (!strcmp(targetChip->getImageExtension(), "fits"))
       {
           void *memptr;
@@ -1990,6 +2107,12 @@ bool INDI::CCD::ExposureComplete(CCDChip *targetChip)
             return false;
           }
 
+          // Tile compressed images go in a compressed extension any FITS reader can open, as fpack does
+          if (targetChip->TileCompressS[1].s == ISS_ON)
+              fits_set_compression_type(fptr, RICE_1, &status);
+          else if (targetChip->TileCompressS[2].s == ISS_ON)
+              fits_set_compression_type(fptr, HCOMPRESS_1, &status);
+
           fits_create_img(fptr, img_type , naxis, naxes, &status);
 
           if (status)
@@ -2012,18 +2135,43 @@ bool INDI::CCD::ExposureComplete(CCDChip *targetChip)
 
           fits_close_file(fptr,&status);
 
-          uploadFile(targetChip, memptr, memsize, sendImage, saveImage);
+          const char *extension = (targetChip->TileCompressS[0].s == ISS_ON) ? "fits" : "fits.fz";
 
-          free(memptr);
+          // The FITS is already a copy of the frame, so the chip may start the next exposure
+          if (asyncUpload)
+              queueUpload(targetChip, memptr, memsize, sendImage, saveImage, extension, compressLevel);
+          else
+          {
+              pthread_mutex_lock(&uploadLock);
+              uploadFile(targetChip, memptr, memsize, sendImage, saveImage, extension, compressLevel);
+              pthread_mutex_unlock(&uploadLock);
+              free(memptr);
+          }
       }
       else
       {
-          uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage, saveImage);
+          void *frameCopy = NULL;
+
+          if (asyncUpload && (frameCopy = malloc(targetChip->getFrameBufferSize())) != NULL)
+          {
+              memcpy(frameCopy, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize());
+              queueUpload(targetChip, frameCopy, targetChip->getFrameBufferSize(), sendImage, saveImage, targetChip->getImageExtension(),
+                          compressLevel);
+          }
+          else
+          {
+              pthread_mutex_lock(&uploadLock);
+              uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage, saveImage, targetChip->getImageExtension(),
+                         compressLevel);
+              pthread_mutex_unlock(&uploadLock);
+          }
       }
 
 
     }
 
+    targetChip->ImageStatsValid = false;
+
     targetChip->ImageExposureNP.s=IPS_OK;
     IDSetNumber(&targetChip->ImageExposureNP,NULL);
 
@@ -2062,16 +2210,17 @@ bool INDI::CCD::ExposureComplete(CCDChip *targetChip)
     return true;
 }
 
-bool INDI::CCD::uploadFile(CCDChip * targetChip, const void *fitsData, size_t totalBytes, bool sendImage, bool saveImage)
+bool INDI::CCD::uploadFile(CCDChip * targetChip, const void *fitsData, size_t totalBytes, bool sendImage, bool saveImage, const char *extension,
+                           int compressLevel)
 {
-    unsigned char *compressedData = NULL;
-    uLongf compressedBytes=0;
+    uint8_t *compressedData = NULL;
+    size_t compressedBytes=0;
 
     if (saveImage)
     {
         targetChip->FitsB.blob=(unsigned char *)fitsData;
         targetChip->FitsB.bloblen=totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", extension);
 
         FILE *fp = NULL;
         char imageFileName[MAXRBUF];
@@ -2111,35 +2260,25 @@ bool INDI::CCD::uploadFile(CCDChip * targetChip, const void *fitsData, size_t to
         fclose(fp);
     }
 
-    if (targetChip->SendCompressed)
+    // Tile compressed FITS would not deflate any further
+    if (compressLevel > 0 && strcmp(extension, "fits.fz"))
     {
-        compressedBytes = sizeof(char) * totalBytes + totalBytes / 64 + 16 + 3;
-        compressedData = (unsigned char *) malloc (compressedBytes);
-
-        if (fitsData == NULL || compressedData == NULL)
+        // zlib stream deflated in parallel slices, still a plain .z for any client
+        if (fitsData == NULL || deflateFrame(&compressedData, &compressedBytes, (const uint8_t *) fitsData, totalBytes,
+                                             compressLevel) == false)
         {
-            if (compressedData)
-                free(compressedData);
             DEBUG(INDI::Logger::DBG_ERROR, "Error: Ran out of memory compressing image");
             return false;
         }
 
-        int r = compress2(compressedData, &compressedBytes, (const Bytef*)fitsData, totalBytes, 9);
-        if (r != Z_OK)
-        {
-            /* this should NEVER happen */
-            DEBUG(INDI::Logger::DBG_ERROR, "Error: Failed to compress image");
-            return false;
-        }
-
         targetChip->FitsB.blob=compressedData;
         targetChip->FitsB.bloblen=compressedBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", targetChip->getImageExtension());
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", extension);
     } else
     {
         targetChip->FitsB.blob=(unsigned char *)fitsData;
         targetChip->FitsB.bloblen=totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
+        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", extension);
     }
 
     targetChip->FitsB.size = totalBytes;
@@ -2154,6 +2293,81 @@ bool INDI::CCD::uploadFile(CCDChip * targetChip, const void *fitsData, size_t to
     return true;
 }
 
+/* Hand data to the upload thread, starting it if needed, and return without
+ * waiting for the upload. Waits only while UPLOAD_QUEUE_DEPTH images are
+ * already queued, so at most that many frames plus the one being uploaded
+ * are held in memory. data must be malloced, it is freed once uploaded.
+ */
+bool INDI::CCD::queueUpload(CCDChip * targetChip, void *data, size_t totalBytes, bool sendImage, bool saveImage, const char *extension,
+                            int compressLevel)
+{
+    UploadJob job = { targetChip, data, totalBytes, sendImage, saveImage };
+
+    snprintf(job.extension, sizeof(job.extension), "%s", extension);
+    job.compressLevel = compressLevel;
+
+    pthread_mutex_lock(&uploadQueueLock);
+
+    if (uploadRunning == false)
+    {
+        if (pthread_create(&uploadTID, NULL, &uploadHelper, this))
+        {
+            pthread_mutex_unlock(&uploadQueueLock);
+            DEBUG(INDI::Logger::DBG_WARNING, "Unable to start upload thread, uploading image in place.");
+
+            pthread_mutex_lock(&uploadLock);
+            bool rc = uploadFile(targetChip, data, totalBytes, sendImage, saveImage, extension, compressLevel);
+            pthread_mutex_unlock(&uploadLock);
+            free(data);
+            return rc;
+        }
+        uploadRunning = true;
+    }
+
+    while (uploadQueue.size() >= UPLOAD_QUEUE_DEPTH)
+        pthread_cond_wait(&uploadQueueCond, &uploadQueueLock);
+
+    uploadQueue.push_back(job);
+    pthread_cond_broadcast(&uploadQueueCond);
+    pthread_mutex_unlock(&uploadQueueLock);
+
+    return true;
+}
+
+void * INDI::CCD::uploadHelper(void *context)
+{
+    (static_cast<INDI::CCD *> (context))->uploadThread();
+    return NULL;
+}
+
+/* Upload queued images in order until told to stop and none are left */
+void INDI::CCD::uploadThread()
+{
+    pthread_mutex_lock(&uploadQueueLock);
+
+    while (true)
+    {
+        while (uploadQueue.empty() && uploadStop == false)
+            pthread_cond_wait(&uploadQueueCond, &uploadQueueLock);
+        if (uploadQueue.empty())
+            break;
+
+        UploadJob job = uploadQueue.front();
+        uploadQueue.pop_front();
+        pthread_cond_broadcast(&uploadQueueCond);
+        pthread_mutex_unlock(&uploadQueueLock);
+
+        pthread_mutex_lock(&uploadLock);
+        uploadFile(job.targetChip, job.data, job.totalBytes, job.sendImage, job.saveImage, job.extension, job.compressLevel);
+        pthread_mutex_unlock(&uploadLock);
+        free(job.data);
+
+        pthread_mutex_lock(&uploadQueueLock);
+    }
+
+    pthread_mutex_unlock(&uploadQueueLock);
+}
+
 void INDI::CCD::SetCCDParams(int x,int y,int bpp,float xf,float yf)
 {
     PrimaryCCD.setResolution(x, y);
@@ -2181,6 +2395,7 @@ bool INDI::CCD::saveConfigItems(FILE *fp)
     IUSaveConfigText(fp, &ActiveDeviceTP);
     IUSaveConfigSwitch(fp, &UploadSP);
     IUSaveConfigText(fp, &UploadSettingsTP);
+    IUSaveConfigSwitch(fp, &UploadAsyncSP);
     //IUSaveConfigSwitch(fp, &WorldCoordSP);
     IUSaveConfigSwitch(fp, &TelescopeTypeSP);
 
@@ -2188,9 +2403,20 @@ bool INDI::CCD::saveConfigItems(FILE *fp)
     //    IUSaveConfigNumber(fp, &CCDRotationNP);
 
     IUSaveConfigSwitch(fp, &PrimaryCCD.CompressSP);
+    IUSaveConfigNumber(fp, &PrimaryCCD.CompressLevelNP);
+    IUSaveConfigSwitch(fp, &PrimaryCCD.TileCompressSP);
 
     if (HasGuideHead())
+    {
         IUSaveConfigSwitch(fp, &GuideCCD.CompressSP);
+        IUSaveConfigNumber(fp, &GuideCCD.CompressLevelNP);
+        IUSaveConfigSwitch(fp, &GuideCCD.TileCompressSP);
+    }
+
+    IUSaveConfigSwitch(fp, &PrimaryCCD.ImageStatsSP);
+
+    if (HasGuideHead())
+        IUSaveConfigSwitch(fp, &GuideCCD.ImageStatsSP);
 
     if (CanSubFrame())
         IUSaveConfigNumber(fp, &PrimaryCCD.ImageFrameNP);
@@ -2234,66 +2460,42 @@ IPState INDI::CCD::GuideWest(float ms)
 
 void INDI::CCD::getMinMax(double *min, double *max, CCDChip *targetChip)
 {
-    int ind=0, i, j;
-    int imageHeight = targetChip->getSubH() / targetChip->getBinY();
-    int imageWidth  = targetChip->getSubW() / targetChip->getBinX();
-    double lmin, lmax;
-
-    switch (targetChip->getBPP())
-    {
-        case 8:
-        {
-            unsigned char *imageBuffer = (unsigned char *) targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
-
+    long npixels = (long) (targetChip->getSubW() / targetChip->getBinX()) * (targetChip->getSubH() / targetChip->getBinY());
 
-            for (i= 0; i < imageHeight ; i++)
-                for (j= 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin) lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax) lmax = imageBuffer[ind];
-                }
-
-        }
-        break;
-
-        case 16:
-        {
-            unsigned short *imageBuffer = (unsigned short* ) targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
-
-            for (i= 0; i < imageHeight ; i++)
-                for (j= 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin) lmin = imageBuffer[ind];
-                     else if (imageBuffer[ind] > lmax) lmax = imageBuffer[ind];
-                }
-
-        }
-        break;
+    if (imageMinMax(targetChip->getFrameBuffer(), npixels, targetChip->getBPP(), min, max) == false)
+        *min = *max = 0;
+}
 
-        case 32:
-        {
-            unsigned int *imageBuffer = (unsigned int* ) targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
+void INDI::CCD::updateImageStats(CCDChip *targetChip)
+{
+    ImageStats stats;
 
-            for (i= 0; i < imageHeight ; i++)
-                for (j= 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin) lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax) lmax = imageBuffer[ind];
+    targetChip->ImageStatsValid = false;
 
-                }
+    if (targetChip->ImageStatsS[0].s != ISS_ON || targetChip->getNAxis() != 2)
+        return;
 
-        }
-        break;
+    long npixels = (long) (targetChip->getSubW() / targetChip->getBinX()) * (targetChip->getSubH() / targetChip->getBinY());
 
+    if (imageStats(&stats, targetChip->getFrameBuffer(), npixels, targetChip->getBPP()) == false)
+    {
+        DEBUGF(Logger::DBG_WARNING, "Failed to compute statistics of %d bits per pixel frame.", targetChip->getBPP());
+        targetChip->ImageStatsNP.s = IPS_ALERT;
+        IDSetNumber(&targetChip->ImageStatsNP, NULL);
+        return;
     }
-        *min = lmin;
-        *max = lmax;
+
+    targetChip->ImageStatsN[0].value = stats.min;
+    targetChip->ImageStatsN[1].value = stats.max;
+    targetChip->ImageStatsN[2].value = stats.mean;
+    targetChip->ImageStatsN[3].value = stats.stddev;
+    targetChip->ImageStatsN[4].value = imagePercentile(&stats, 0.5);
+    targetChip->ImageStatsN[5].value = imagePercentile(&stats, 0.01);
+    targetChip->ImageStatsN[6].value = imagePercentile(&stats, 0.99);
+    targetChip->ImageStatsValid = true;
+
+    targetChip->ImageStatsNP.s = IPS_OK;
+    IDSetNumber(&targetChip->ImageStatsNP, NULL);
 }
 
 int INDI::CCD::getFileIndex(const char *dir, const char *prefix, const char *ext)
@@ -28,6 +28,8 @@
 
 #include <fitsio.h>
 #include <string.h>
+#include <pthread.h>
+#include <deque>
 
 #include "defaultdevice.h"
 #include "indiguiderinterface.h"
@@ -310,6 +312,8 @@ public:
 
     /**
      * @brief binFrame Perform softwre binning on the CCD frame. Only use this function if hardware binning is not supported.
+     * Each BinX by BinY block of pixels is summed into one, saturating at the largest pixel value. 8, 16 and 32 bits per pixel
+     * are supported. Large frames are binned by several threads. If memory runs out the frame is left unbinned.
      */
     void binFrame();
 
@@ -360,6 +364,12 @@ private:
     ISwitch CompressS[2];
     ISwitchVectorProperty CompressSP;
 
+    INumber CompressLevelN[1];
+    INumberVectorProperty CompressLevelNP;
+
+    ISwitch TileCompressS[3];
+    ISwitchVectorProperty TileCompressSP;
+
     IBLOB FitsB;
     IBLOBVectorProperty FitsBP;
 
@@ -372,6 +382,13 @@ private:
     INumber RapidGuideDataN[3];
     INumberVectorProperty RapidGuideDataNP;
 
+    ISwitch ImageStatsS[2];
+    ISwitchVectorProperty ImageStatsSP;
+
+    INumber ImageStatsN[7];
+    INumberVectorProperty ImageStatsNP;
+    bool ImageStatsValid;       // ImageStatsN holds the statistics of the frame being completed
+
     ISwitch                 ResetS[1];
     ISwitchVectorProperty   ResetSP;
 
@@ -652,6 +669,7 @@ class INDI::CCD : public INDI::DefaultDevice, INDI::GuiderInterface
             <li>FRAME: Frame Type</li>
             <li>DATAMIN: Minimum value</li>
             <li>DATAMAX: Maximum value</li>
+            <li>DATAMEAN, DATASTD, DATAMED (if statistics are enabled): Mean, standard deviation and median value</li>
             <li>INSTRUME: CCD Name</li>
             <li>DATE-OBS: UTC start date of observation</li>
             </ul>
@@ -733,13 +751,42 @@ class INDI::CCD : public INDI::DefaultDevice, INDI::GuiderInterface
         IText   UploadSettingsT[2];
         ITextVectorProperty UploadSettingsTP;
 
+        ISwitch UploadAsyncS[2];
+        ISwitchVectorProperty UploadAsyncSP;
+
      private:
         uint32_t capability;
 
         bool ValidCCDRotation;
 
-        bool uploadFile(CCDChip * targetChip, const void *fitsData, size_t totalBytes, bool sendImage, bool saveImage);
+        /* An image waiting for the upload thread. data is malloced and freed once uploaded. */
+        struct UploadJob
+        {
+            CCDChip *targetChip;
+            void *data;
+            size_t totalBytes;
+            bool sendImage;
+            bool saveImage;
+            char extension[MAXINDIBLOBFMT];
+            int compressLevel;          // zlib level, 0 to send uncompressed
+        };
+
+        std::deque<UploadJob> uploadQueue;
+        pthread_t uploadTID;
+        pthread_mutex_t uploadQueueLock;    // guards uploadQueue, uploadRunning and uploadStop
+        pthread_cond_t uploadQueueCond;     // signalled when uploadQueue changes
+        pthread_mutex_t uploadLock;         // held by whoever is in uploadFile()
+        bool uploadRunning;
+        bool uploadStop;
+
+        bool uploadFile(CCDChip * targetChip, const void *fitsData, size_t totalBytes, bool sendImage, bool saveImage, const char *extension,
+                        int compressLevel);
+        bool queueUpload(CCDChip * targetChip, void *data, size_t totalBytes, bool sendImage, bool saveImage, const char *extension,
+                         int compressLevel);
+        void uploadThread();
+        static void * uploadHelper(void *context);
         void getMinMax(double *min, double *max, CCDChip *targetChip);
+        void updateImageStats(CCDChip *targetChip);
         int getFileIndex(const char *dir, const char *prefix, const char *ext);
 
         friend class ::StreamRecorder;
@@ -0,0 +1,1188 @@
+/*******************************************************************************
+ Copyright(c) 2010, 2011 Gerry Rozema, Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "indiccdimage.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+// Frames with fewer source pixels than this are done by the caller alone
+const int BAND_MIN_PIXELS = 1 << 18;
+
+// Most threads working on one frame, the caller included
+const int BAND_MAX_THREADS = 8;
+
+/******************************************************************************
+ * Thread pool
+ ******************************************************************************/
+
+typedef void (*BandFunc)(void *arg, int band, int nbands);
+
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t poolUse = PTHREAD_MUTEX_INITIALIZER;      // one job at a time
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;     // guards the job below
+static pthread_cond_t poolJobCond = PTHREAD_COND_INITIALIZER;    // signalled when a job is posted
+static pthread_cond_t poolDoneCond = PTHREAD_COND_INITIALIZER;   // signalled when the last band is done
+static int poolThreads = 1;                                      // workers plus the caller
+static BandFunc poolFunc;                                        // job, NULL if none
+static void *poolArg;
+static int poolBands, poolNextBand, poolBandsLeft;
+
+static void * poolWorker(void *)
+{
+    pthread_mutex_lock(&poolLock);
+
+    for (;;)
+    {
+        while (poolFunc == NULL || poolNextBand >= poolBands)
+            pthread_cond_wait(&poolJobCond, &poolLock);
+
+        BandFunc func = poolFunc;
+        void *arg = poolArg;
+        int band = poolNextBand++;
+        int nbands = poolBands;
+
+        pthread_mutex_unlock(&poolLock);
+        func(arg, band, nbands);
+        pthread_mutex_lock(&poolLock);
+
+        if (--poolBandsLeft == 0)
+            pthread_cond_signal(&poolDoneCond);
+    }
+
+    return NULL;
+}
+
+static void poolStart()
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = (ncpu < 1) ? 1 : (ncpu > BAND_MAX_THREADS) ? BAND_MAX_THREADS : ncpu;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (int i=1; i < nthreads; i++)
+    {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, poolWorker, NULL) == 0)
+            poolThreads++;
+    }
+
+    pthread_attr_destroy(&attr);
+}
+
+/* run func on bands 0 .. nbands-1, sharing them between the pool and the
+ * caller, and return once all are done.
+ */
+static void runBands(BandFunc func, void *arg, int nbands)
+{
+    pthread_mutex_lock(&poolUse);
+    pthread_mutex_lock(&poolLock);
+
+    poolFunc = func;
+    poolArg = arg;
+    poolBands = nbands;
+    poolNextBand = 0;
+    poolBandsLeft = nbands;
+    pthread_cond_broadcast(&poolJobCond);
+
+    while (poolNextBand < poolBands)
+    {
+        int band = poolNextBand++;
+
+        pthread_mutex_unlock(&poolLock);
+        func(arg, band, nbands);
+        pthread_mutex_lock(&poolLock);
+
+        poolBandsLeft--;
+    }
+
+    while (poolBandsLeft > 0)
+        pthread_cond_wait(&poolDoneCond, &poolLock);
+
+    poolFunc = NULL;
+
+    pthread_mutex_unlock(&poolLock);
+    pthread_mutex_unlock(&poolUse);
+}
+
+/* number of bands to split nrows rows of npixels source pixels into */
+static int bandCount(long npixels, int nrows)
+{
+    if (npixels < BAND_MIN_PIXELS || nrows < 2)
+        return 1;
+
+    pthread_once(&poolOnce, poolStart);
+
+    return (poolThreads < nrows) ? poolThreads : nrows;
+}
+
+/******************************************************************************
+ * Binning
+ ******************************************************************************/
+
+struct BinJob
+{
+    uint8_t *dst;
+    const uint8_t *src;
+    int w, binx, biny, bpp;
+    int outw, outh;
+    bool failed[BAND_MAX_THREADS];      // band ran out of memory
+};
+
+/* 2x2 binning of one row pair into dst, returning how many binned pixels
+ * were done, the rest are left to the caller. Since pixels are never
+ * negative, adding all four and then saturating is the same as saturating
+ * each add.
+ */
+static int bin2x2Row8(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, int outw)
+{
+    int j = 0;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+    for (; j+16 <= outw; j += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (r0 + 2*j));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (r0 + 2*j + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (r1 + 2*j));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (r1 + 2*j + 16));
+        __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, lo), _mm_srli_epi16(a0, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b0, lo), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, lo), _mm_srli_epi16(a1, 8)),
+                                   _mm_add_epi16(_mm_and_si128(b1, lo), _mm_srli_epi16(b1, 8)));
+        _mm_storeu_si128((__m128i *) (dst + j), _mm_packus_epi16(s0, s1));
+    }
+#elif defined(HAVE_NEON)
+    for (; j+8 <= outw; j += 8)
+    {
+        uint16x8_t s = vpaddlq_u8(vld1q_u8(r0 + 2*j));
+        s = vpadalq_u8(s, vld1q_u8(r1 + 2*j));
+        vst1_u8(dst + j, vqmovn_u16(s));
+    }
+#endif
+
+    return j;
+}
+
+static int bin2x2Row16(uint16_t *dst, const uint16_t *r0, const uint16_t *r1, int outw)
+{
+    int j = 0;
+
+#if defined(__SSE2__)
+    // no unsigned 32 to 16 bit pack in SSE2, so bias into the signed one
+    const __m128i lo = _mm_set1_epi32(0xffff);
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short) 0x8000);
+    for (; j+8 <= outw; j += 8)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (r0 + 2*j));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (r0 + 2*j + 8));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (r1 + 2*j));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (r1 + 2*j + 8));
+        __m128i s0 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a0, lo), _mm_srli_epi32(a0, 16)),
+                                   _mm_add_epi32(_mm_and_si128(b0, lo), _mm_srli_epi32(b0, 16)));
+        __m128i s1 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(a1, lo), _mm_srli_epi32(a1, 16)),
+                                   _mm_add_epi32(_mm_and_si128(b1, lo), _mm_srli_epi32(b1, 16)));
+        __m128i p = _mm_packs_epi32(_mm_sub_epi32(s0, bias32), _mm_sub_epi32(s1, bias32));
+        _mm_storeu_si128((__m128i *) (dst + j), _mm_xor_si128(p, bias16));
+    }
+#elif defined(HAVE_NEON)
+    for (; j+4 <= outw; j += 4)
+    {
+        uint32x4_t s = vpaddlq_u16(vld1q_u16(r0 + 2*j));
+        s = vpadalq_u16(s, vld1q_u16(r1 + 2*j));
+        vst1_u16(dst + j, vqmovn_u32(s));
+    }
+#endif
+
+    return j;
+}
+
+/* add n pixels of a source row to the 32 bit column sums in acc */
+static void addRow8(uint32_t *acc, const uint8_t *row, int n)
+{
+    int j = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; j+16 <= n; j += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (row + j));
+        __m128i vlo = _mm_unpacklo_epi8(v, zero);
+        __m128i vhi = _mm_unpackhi_epi8(v, zero);
+        __m128i *a = (__m128i *) (acc + j);
+        _mm_storeu_si128(a,   _mm_add_epi32(_mm_loadu_si128(a),   _mm_unpacklo_epi16(vlo, zero)));
+        _mm_storeu_si128(a+1, _mm_add_epi32(_mm_loadu_si128(a+1), _mm_unpackhi_epi16(vlo, zero)));
+        _mm_storeu_si128(a+2, _mm_add_epi32(_mm_loadu_si128(a+2), _mm_unpacklo_epi16(vhi, zero)));
+        _mm_storeu_si128(a+3, _mm_add_epi32(_mm_loadu_si128(a+3), _mm_unpackhi_epi16(vhi, zero)));
+    }
+#elif defined(HAVE_NEON)
+    for (; j+8 <= n; j += 8)
+    {
+        uint16x8_t v = vmovl_u8(vld1_u8(row + j));
+        vst1q_u32(acc + j,     vaddw_u16(vld1q_u32(acc + j),     vget_low_u16(v)));
+        vst1q_u32(acc + j + 4, vaddw_u16(vld1q_u32(acc + j + 4), vget_high_u16(v)));
+    }
+#endif
+
+    for (; j < n; j++)
+        acc[j] += row[j];
+}
+
+static void addRow16(uint32_t *acc, const uint16_t *row, int n)
+{
+    int j = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; j+8 <= n; j += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (row + j));
+        __m128i *a = (__m128i *) (acc + j);
+        _mm_storeu_si128(a,   _mm_add_epi32(_mm_loadu_si128(a),   _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128(a+1, _mm_add_epi32(_mm_loadu_si128(a+1), _mm_unpackhi_epi16(v, zero)));
+    }
+#elif defined(HAVE_NEON)
+    for (; j+4 <= n; j += 4)
+        vst1q_u32(acc + j, vaddw_u16(vld1q_u32(acc + j), vld1_u16(row + j)));
+#endif
+
+    for (; j < n; j++)
+        acc[j] += row[j];
+}
+
+static void addRow32(uint64_t *acc, const uint32_t *row, int n)
+{
+    for (int j=0; j < n; j++)
+        acc[j] += row[j];
+}
+
+/* sum each binx column sums of acc into one pixel of dst, saturating at max */
+template <typename P, typename A>
+static void sumColumns(P *dst, const A *acc, int outw, int binx, A max)
+{
+    switch (binx)
+    {
+    // the common ones unrolled
+    case 1:
+        for (int j=0; j < outw; j++)
+            dst[j] = (P) (acc[j] > max ? max : acc[j]);
+        break;
+    case 2:
+        for (int j=0; j < outw; j++)
+        {
+            A s = acc[2*j] + acc[2*j+1];
+            dst[j] = (P) (s > max ? max : s);
+        }
+        break;
+    case 3:
+        for (int j=0; j < outw; j++)
+        {
+            A s = acc[3*j] + acc[3*j+1] + acc[3*j+2];
+            dst[j] = (P) (s > max ? max : s);
+        }
+        break;
+    case 4:
+        for (int j=0; j < outw; j++)
+        {
+            A s = acc[4*j] + acc[4*j+1] + acc[4*j+2] + acc[4*j+3];
+            dst[j] = (P) (s > max ? max : s);
+        }
+        break;
+    default:
+        for (int j=0; j < outw; j++)
+        {
+            A s = 0;
+            for (int l=0; l < binx; l++)
+                s += acc[binx*j + l];
+            dst[j] = (P) (s > max ? max : s);
+        }
+        break;
+    }
+}
+
+/* bin the rows of one band, with 2x2 8 and 16 bit done directly and the
+ * rest through column sums of each group of biny rows.
+ */
+static void binBand(void *arg, int band, int nbands)
+{
+    BinJob *job = static_cast<BinJob *> (arg);
+    int r0 = (int) ((long) job->outh * band / nbands);
+    int r1 = (int) ((long) job->outh * (band+1) / nbands);
+    int n  = job->outw * job->binx;     // source columns used
+    int bytes = job->bpp / 8;
+    void *acc = NULL;
+
+    job->failed[band] = false;
+
+    if (job->binx == 2 && job->biny == 2 && job->bpp != 32)
+    {
+        for (int i=r0; i < r1; i++)
+        {
+            const uint8_t *s0 = job->src + (long) 2*i * job->w * bytes;
+            const uint8_t *s1 = s0 + (long) job->w * bytes;
+            uint8_t *d = job->dst + (long) i * job->outw * bytes;
+
+            if (job->bpp == 8)
+            {
+                for (int j = bin2x2Row8(d, s0, s1, job->outw); j < job->outw; j++)
+                {
+                    int s = s0[2*j] + s0[2*j+1] + s1[2*j] + s1[2*j+1];
+                    d[j] = (s > UINT8_MAX) ? UINT8_MAX : s;
+                }
+            }
+            else
+            {
+                const uint16_t *a = (const uint16_t *) s0, *b = (const uint16_t *) s1;
+                uint16_t *d16 = (uint16_t *) d;
+                for (int j = bin2x2Row16(d16, a, b, job->outw); j < job->outw; j++)
+                {
+                    uint32_t s = a[2*j] + a[2*j+1] + b[2*j] + b[2*j+1];
+                    d16[j] = (s > UINT16_MAX) ? UINT16_MAX : s;
+                }
+            }
+        }
+        return;
+    }
+
+    acc = malloc((long) n * (job->bpp == 32 ? sizeof(uint64_t) : sizeof(uint32_t)));
+    if (acc == NULL)
+    {
+        job->failed[band] = true;
+        return;
+    }
+
+    for (int i=r0; i < r1; i++)
+    {
+        const uint8_t *s = job->src + (long) i * job->biny * job->w * bytes;
+        uint8_t *d = job->dst + (long) i * job->outw * bytes;
+
+        switch (job->bpp)
+        {
+        case 8:
+            memset(acc, 0, n * sizeof(uint32_t));
+            for (int k=0; k < job->biny; k++)
+                addRow8((uint32_t *) acc, s + (long) k * job->w, n);
+            sumColumns(d, (uint32_t *) acc, job->outw, job->binx, (uint32_t) UINT8_MAX);
+            break;
+
+        case 16:
+            memset(acc, 0, n * sizeof(uint32_t));
+            for (int k=0; k < job->biny; k++)
+                addRow16((uint32_t *) acc, (const uint16_t *) s + (long) k * job->w, n);
+            sumColumns((uint16_t *) d, (uint32_t *) acc, job->outw, job->binx, (uint32_t) UINT16_MAX);
+            break;
+
+        case 32:
+            memset(acc, 0, n * sizeof(uint64_t));
+            for (int k=0; k < job->biny; k++)
+                addRow32((uint64_t *) acc, (const uint32_t *) s + (long) k * job->w, n);
+            sumColumns((uint32_t *) d, (uint64_t *) acc, job->outw, job->binx, (uint64_t) UINT32_MAX);
+            break;
+        }
+    }
+
+    free(acc);
+}
+
+bool binPixels(uint8_t *dst, const uint8_t *src, int w, int h, int binx, int biny, int bpp)
+{
+    BinJob job;
+
+    if (bpp != 8 && bpp != 16 && bpp != 32)
+        return false;
+
+    job.dst  = dst;
+    job.src  = src;
+    job.w    = w;
+    job.binx = binx;
+    job.biny = biny;
+    job.bpp  = bpp;
+    job.outw = w / binx;
+    job.outh = h / biny;
+
+    if (job.outw <= 0 || job.outh <= 0)
+        return true;
+
+    int nbands = bandCount((long) w * h, job.outh);
+    if (nbands == 1)
+        binBand(&job, 0, 1);
+    else
+        runBands(binBand, &job, nbands);
+
+    // a band left unwritten spoils the whole frame
+    for (int b=0; b < nbands; b++)
+        if (job.failed[b])
+            return false;
+
+    return true;
+}
+
+/******************************************************************************
+ * Statistics
+ ******************************************************************************/
+
+struct MinMaxJob
+{
+    const uint8_t *pixels;
+    long npixels;
+    int bpp;
+    uint32_t min[BAND_MAX_THREADS];
+    uint32_t max[BAND_MAX_THREADS];
+};
+
+/* first and last pixel of a band of a flat run of npixels */
+static void bandRange(long npixels, int band, int nbands, long *p0, long *p1)
+{
+    *p0 = (long) ((double) npixels * band / nbands);
+    *p1 = (band == nbands-1) ? npixels : (long) ((double) npixels * (band+1) / nbands);
+}
+
+/* min and max of n pixels into lo and hi, which must be seeded by the caller */
+static void minMax8(const uint8_t *p, long n, uint32_t *lo, uint32_t *hi)
+{
+    long i = 0;
+    uint8_t l = *lo, h = *hi;
+
+#if defined(__SSE2__) || defined(HAVE_NEON)
+    if (n >= 16)
+    {
+        uint8_t vl[16], vh[16];
+#if defined(__SSE2__)
+        __m128i mn = _mm_set1_epi8((char) l), mx = _mm_set1_epi8((char) h);
+        for (; i+16 <= n; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+            mn = _mm_min_epu8(mn, v);
+            mx = _mm_max_epu8(mx, v);
+        }
+        _mm_storeu_si128((__m128i *) vl, mn);
+        _mm_storeu_si128((__m128i *) vh, mx);
+#else
+        uint8x16_t mn = vdupq_n_u8(l), mx = vdupq_n_u8(h);
+        for (; i+16 <= n; i += 16)
+        {
+            uint8x16_t v = vld1q_u8(p + i);
+            mn = vminq_u8(mn, v);
+            mx = vmaxq_u8(mx, v);
+        }
+        vst1q_u8(vl, mn);
+        vst1q_u8(vh, mx);
+#endif
+        for (int k=0; k < 16; k++)
+        {
+            if (vl[k] < l) l = vl[k];
+            if (vh[k] > h) h = vh[k];
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        if (p[i] < l) l = p[i];
+        if (p[i] > h) h = p[i];
+    }
+
+    *lo = l;
+    *hi = h;
+}
+
+static void minMax16(const uint16_t *p, long n, uint32_t *lo, uint32_t *hi)
+{
+    long i = 0;
+    uint16_t l = *lo, h = *hi;
+
+#if defined(__SSE2__) || defined(HAVE_NEON)
+    if (n >= 8)
+    {
+        uint16_t vl[8], vh[8];
+#if defined(__SSE2__)
+        // SSE2 only has signed 16 bit min and max, so flip the sign bit around them
+        const __m128i bias = _mm_set1_epi16((short) 0x8000);
+        __m128i mn = _mm_set1_epi16((short) (l ^ 0x8000)), mx = _mm_set1_epi16((short) (h ^ 0x8000));
+        for (; i+8 <= n; i += 8)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (p + i)), bias);
+            mn = _mm_min_epi16(mn, v);
+            mx = _mm_max_epi16(mx, v);
+        }
+        _mm_storeu_si128((__m128i *) vl, _mm_xor_si128(mn, bias));
+        _mm_storeu_si128((__m128i *) vh, _mm_xor_si128(mx, bias));
+#else
+        uint16x8_t mn = vdupq_n_u16(l), mx = vdupq_n_u16(h);
+        for (; i+8 <= n; i += 8)
+        {
+            uint16x8_t v = vld1q_u16(p + i);
+            mn = vminq_u16(mn, v);
+            mx = vmaxq_u16(mx, v);
+        }
+        vst1q_u16(vl, mn);
+        vst1q_u16(vh, mx);
+#endif
+        for (int k=0; k < 8; k++)
+        {
+            if (vl[k] < l) l = vl[k];
+            if (vh[k] > h) h = vh[k];
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        if (p[i] < l) l = p[i];
+        if (p[i] > h) h = p[i];
+    }
+
+    *lo = l;
+    *hi = h;
+}
+
+static void minMax32(const uint32_t *p, long n, uint32_t *lo, uint32_t *hi)
+{
+    long i = 0;
+    uint32_t l = *lo, h = *hi;
+
+#if defined(HAVE_NEON)
+    if (n >= 4)
+    {
+        uint32_t vl[4], vh[4];
+        uint32x4_t mn = vdupq_n_u32(l), mx = vdupq_n_u32(h);
+        for (; i+4 <= n; i += 4)
+        {
+            uint32x4_t v = vld1q_u32(p + i);
+            mn = vminq_u32(mn, v);
+            mx = vmaxq_u32(mx, v);
+        }
+        vst1q_u32(vl, mn);
+        vst1q_u32(vh, mx);
+        for (int k=0; k < 4; k++)
+        {
+            if (vl[k] < l) l = vl[k];
+            if (vh[k] > h) h = vh[k];
+        }
+    }
+#endif
+
+    // SSE2 has no 32 bit min and max, branch free so the compiler can use later ones
+    for (; i < n; i++)
+    {
+        l = (p[i] < l) ? p[i] : l;
+        h = (p[i] > h) ? p[i] : h;
+    }
+
+    *lo = l;
+    *hi = h;
+}
+
+static void minMaxBand(void *arg, int band, int nbands)
+{
+    MinMaxJob *job = static_cast<MinMaxJob *> (arg);
+    long p0, p1;
+
+    bandRange(job->npixels, band, nbands, &p0, &p1);
+
+    job->min[band] = UINT32_MAX;
+    job->max[band] = 0;
+
+    switch (job->bpp)
+    {
+    case 8:
+        minMax8(job->pixels + p0, p1 - p0, &job->min[band], &job->max[band]);
+        break;
+    case 16:
+        minMax16((const uint16_t *) job->pixels + p0, p1 - p0, &job->min[band], &job->max[band]);
+        break;
+    case 32:
+        minMax32((const uint32_t *) job->pixels + p0, p1 - p0, &job->min[band], &job->max[band]);
+        break;
+    }
+}
+
+bool imageMinMax(const uint8_t *pixels, long npixels, int bpp, double *min, double *max)
+{
+    MinMaxJob job;
+
+    if (bpp != 8 && bpp != 16 && bpp != 32)
+        return false;
+
+    *min = *max = 0;
+
+    if (npixels <= 0)
+        return true;
+
+    job.pixels  = pixels;
+    job.npixels = npixels;
+    job.bpp     = bpp;
+
+    int nbands = bandCount(npixels, BAND_MAX_THREADS);
+    if (nbands == 1)
+        minMaxBand(&job, 0, 1);
+    else
+        runBands(minMaxBand, &job, nbands);
+
+    uint32_t lo = job.min[0], hi = job.max[0];
+    for (int b=1; b < nbands; b++)
+    {
+        if (job.min[b] < lo) lo = job.min[b];
+        if (job.max[b] > hi) hi = job.max[b];
+    }
+
+    *min = lo;
+    *max = hi;
+
+    return true;
+}
+
+struct StatsJob
+{
+    const uint8_t *pixels;
+    long npixels;
+    int bpp;
+    int nbins;
+    uint32_t *histogram[BAND_MAX_THREADS];      // one per band, NULL if out of memory
+    // 32 bit only, the rest comes from the histogram
+    uint32_t min[BAND_MAX_THREADS];
+    uint32_t max[BAND_MAX_THREADS];
+    double sum[BAND_MAX_THREADS];
+    double sumsq[BAND_MAX_THREADS];
+};
+
+/* histogram one band. 8 bit pixels are counted in four histograms in turn so
+ * runs of equal pixels do not wait on each other's increment.
+ */
+static void statsBand(void *arg, int band, int nbands)
+{
+    StatsJob *job = static_cast<StatsJob *> (arg);
+    long p0, p1, i;
+
+    bandRange(job->npixels, band, nbands, &p0, &p1);
+
+    uint32_t *hist = (uint32_t *) calloc(job->bpp == 8 ? 4*256 : job->nbins, sizeof(uint32_t));
+    job->histogram[band] = hist;
+    if (hist == NULL)
+        return;
+
+    switch (job->bpp)
+    {
+    case 8:
+    {
+        const uint8_t *p = job->pixels;
+        uint32_t *h0 = hist, *h1 = hist + 256, *h2 = hist + 512, *h3 = hist + 768;
+        for (i=p0; i+4 <= p1; i += 4)
+        {
+            h0[p[i]]++;
+            h1[p[i+1]]++;
+            h2[p[i+2]]++;
+            h3[p[i+3]]++;
+        }
+        for (; i < p1; i++)
+            h0[p[i]]++;
+        for (int b=0; b < 256; b++)
+            h0[b] += h1[b] + h2[b] + h3[b];
+        break;
+    }
+
+    case 16:
+    {
+        const uint16_t *p = (const uint16_t *) job->pixels;
+        for (i=p0; i < p1; i++)
+            hist[p[i]]++;
+        break;
+    }
+
+    case 32:
+    {
+        const uint32_t *p = (const uint32_t *) job->pixels;
+        uint32_t lo = UINT32_MAX, hi = 0;
+        double sum = 0, sumsq = 0;
+        for (i=p0; i < p1; i++)
+        {
+            uint32_t v = p[i];
+            hist[v >> 16]++;
+            lo = (v < lo) ? v : lo;
+            hi = (v > hi) ? v : hi;
+            sum += v;
+            sumsq += (double) v * v;
+        }
+        job->min[band] = lo;
+        job->max[band] = hi;
+        job->sum[band] = sum;
+        job->sumsq[band] = sumsq;
+        break;
+    }
+    }
+}
+
+bool imageStats(ImageStats *stats, const uint8_t *pixels, long npixels, int bpp)
+{
+    StatsJob job;
+    bool ok = true;
+
+    if (bpp != 8 && bpp != 16 && bpp != 32)
+        return false;
+
+    if (npixels < 0)
+        npixels = 0;
+
+    job.pixels  = pixels;
+    job.npixels = npixels;
+    job.bpp     = bpp;
+    job.nbins   = (bpp == 8) ? 256 : 65536;
+
+    stats->count = npixels;
+    stats->shift = (bpp == 32) ? 16 : 0;
+    stats->min = stats->max = stats->mean = stats->stddev = 0;
+    stats->histogram.assign(job.nbins, 0);
+
+    int nbands = bandCount(npixels, BAND_MAX_THREADS);
+    if (nbands == 1)
+        statsBand(&job, 0, 1);
+    else
+        runBands(statsBand, &job, nbands);
+
+    for (int b=0; b < nbands; b++)
+    {
+        if (job.histogram[b] == NULL)
+        {
+            ok = false;
+            continue;
+        }
+        for (int k=0; k < job.nbins; k++)
+            stats->histogram[k] += job.histogram[b][k];
+        free(job.histogram[b]);
+    }
+
+    if (!ok || npixels == 0)
+        return ok;
+
+    double sum = 0, sumsq = 0;
+
+    if (bpp == 32)
+    {
+        uint32_t lo = job.min[0], hi = job.max[0];
+        for (int b=0; b < nbands; b++)
+        {
+            if (job.min[b] < lo) lo = job.min[b];
+            if (job.max[b] > hi) hi = job.max[b];
+            sum += job.sum[b];
+            sumsq += job.sumsq[b];
+        }
+        stats->min = lo;
+        stats->max = hi;
+    }
+    else
+    {
+        int lo = -1, hi = 0;
+        for (int k=0; k < job.nbins; k++)
+        {
+            uint32_t c = stats->histogram[k];
+            if (c == 0)
+                continue;
+            if (lo < 0)
+                lo = k;
+            hi = k;
+            sum += (double) k * c;
+            sumsq += (double) k * k * c;
+        }
+        stats->min = lo;
+        stats->max = hi;
+    }
+
+    stats->mean = sum / npixels;
+    double var = sumsq / npixels - stats->mean * stats->mean;
+    stats->stddev = (var > 0) ? sqrt(var) : 0;
+
+    return true;
+}
+
+double imagePercentile(const ImageStats *stats, double p)
+{
+    if (stats->count <= 0 || stats->histogram.empty())
+        return 0;
+
+    // smallest value with at least p of the pixels at or below it
+    double rank = ceil(p * stats->count);
+    if (rank < 1)
+        rank = 1;
+
+    double seen = 0;
+    for (size_t k=0; k < stats->histogram.size(); k++)
+    {
+        seen += stats->histogram[k];
+        if (seen < rank)
+            continue;
+
+        if (stats->shift == 0)
+            return k;
+
+        // middle of a wide bin, kept within the pixels actually seen
+        double v = ((double) k + 0.5) * (1 << stats->shift);
+        return (v < stats->min) ? stats->min : (v > stats->max) ? stats->max : v;
+    }
+
+    return stats->max;
+}
+
+/******************************************************************************
+ * Compression
+ ******************************************************************************/
+
+// Bytes of zlib header and adler32 trailer around the deflate data
+const int ZLIB_HEADER = 2;
+const int ZLIB_TRAILER = 4;
+
+// Deflate window, the most input one band can refer back to
+const int DEFLATE_WINDOW = 32768;
+
+struct DeflateJob
+{
+    uint8_t *out;
+    const uint8_t *in;
+    size_t len;
+    int level;
+    size_t start[BAND_MAX_THREADS];     // where each band may write in out
+    size_t outlen[BAND_MAX_THREADS];    // how much it wrote, 0 on error
+    uLong adler[BAND_MAX_THREADS];      // adler32 of its input
+};
+
+static size_t deflateBandBound(size_t len)
+{
+    // raw deflate is never larger than a zlib stream, plus the flush marker
+    return compressBound(len) + 16;
+}
+
+/* deflate one slice of the input as raw deflate data, primed with the window
+ * before it so the output matches a single stream closely. All but the last
+ * band end on a byte boundary with a sync flush so the bands simply follow
+ * each other.
+ */
+static void deflateBand(void *arg, int band, int nbands)
+{
+    DeflateJob *job = static_cast<DeflateJob *> (arg);
+    long p0, p1;
+    z_stream zs;
+
+    bandRange(job->len, band, nbands, &p0, &p1);
+
+    job->outlen[band] = 0;
+    job->adler[band] = adler32(adler32(0, NULL, 0), job->in + p0, p1 - p0);
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, job->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    if (p0 > 0)
+    {
+        long dict = (p0 < DEFLATE_WINDOW) ? p0 : DEFLATE_WINDOW;
+        deflateSetDictionary(&zs, job->in + p0 - dict, dict);
+    }
+
+    zs.next_in   = (Bytef *) job->in + p0;
+    zs.avail_in  = p1 - p0;
+    zs.next_out  = job->out + job->start[band];
+    zs.avail_out = deflateBandBound(p1 - p0);
+
+    int last = (band == nbands-1);
+    int r = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+
+    if (zs.avail_in == 0 && (last ? r == Z_STREAM_END : r == Z_OK))
+        job->outlen[band] = zs.total_out;
+
+    deflateEnd(&zs);
+}
+
+bool deflateFrame(uint8_t **out, size_t *outlen, const uint8_t *in, size_t len, int level)
+{
+    DeflateJob job;
+
+    if (level < 1 || level > 9)
+        level = Z_DEFAULT_COMPRESSION;
+
+    // a slice must fit one deflate() call
+    int nbands = (len > (size_t) UINT32_MAX / 2) ? BAND_MAX_THREADS : bandCount(len, BAND_MAX_THREADS);
+
+    job.in    = in;
+    job.len   = len;
+    job.level = level;
+
+    size_t total = ZLIB_HEADER;
+    for (int b=0; b < nbands; b++)
+    {
+        long p0, p1;
+        bandRange(len, b, nbands, &p0, &p1);
+        job.start[b] = total;
+        total += deflateBandBound(p1 - p0);
+    }
+
+    job.out = (uint8_t *) malloc(total + ZLIB_TRAILER);
+    if (job.out == NULL)
+        return false;
+
+    if (nbands == 1)
+        deflateBand(&job, 0, 1);
+    else
+        runBands(deflateBand, &job, nbands);
+
+    // header with the level hint, then close up the gaps between bands
+    int flevel = (level == Z_DEFAULT_COMPRESSION) ? 2 : (level == 1) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+    int flg = flevel << 6;
+    flg += 31 - (0x7800 + flg) % 31;
+
+    job.out[0] = 0x78;
+    job.out[1] = flg;
+
+    size_t n = ZLIB_HEADER;
+    uLong adler = adler32(0, NULL, 0);
+
+    for (int b=0; b < nbands; b++)
+    {
+        long p0, p1;
+
+        if (job.outlen[b] == 0)
+        {
+            free(job.out);
+            return false;
+        }
+
+        bandRange(len, b, nbands, &p0, &p1);
+        memmove(job.out + n, job.out + job.start[b], job.outlen[b]);
+        n += job.outlen[b];
+        adler = adler32_combine(adler, job.adler[b], p1 - p0);
+    }
+
+    job.out[n++] = adler >> 24;
+    job.out[n++] = adler >> 16;
+    job.out[n++] = adler >> 8;
+    job.out[n++] = adler;
+
+    *out = job.out;
+    *outlen = n;
+
+    return true;
+}
+
+#ifdef CCDIMAGE_BENCHMARK
+/* standalone program that checks the kernels against plain loops and times them.
+ * built as ccdimagebench with -DINDI_BENCHMARKS=ON, make benchmarks runs it.
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+template <typename P>
+static bool check(const uint8_t *dst8, const uint8_t *src8, int w, int h, int binx, int biny, uint64_t max)
+{
+    const P *dst = (const P *) dst8, *src = (const P *) src8;
+
+    for (int i=0; i < h/biny; i++)
+        for (int j=0; j < w/binx; j++)
+        {
+            uint64_t s = 0;
+            for (int k=0; k < biny; k++)
+                for (int l=0; l < binx; l++)
+                    s += src[(i*biny + k) * w + j*binx + l];
+            if (dst[i * (w/binx) + j] != (s > max ? max : s))
+                return false;
+        }
+
+    return true;
+}
+
+template <typename P>
+static bool checkStats(const uint8_t *src8, long n, int bpp)
+{
+    const P *src = (const P *) src8;
+    ImageStats stats;
+    double min, max, sum = 0, sumsq = 0;
+    P lo = src[0], hi = src[0];
+
+    for (long i=0; i < n; i++)
+    {
+        if (src[i] < lo) lo = src[i];
+        if (src[i] > hi) hi = src[i];
+        sum += src[i];
+        sumsq += (double) src[i] * src[i];
+    }
+
+    double mean = sum / n, stddev = sqrt(sumsq / n - mean * mean);
+
+    if (!imageMinMax(src8, n, bpp, &min, &max) || min != lo || max != hi)
+        return false;
+
+    if (!imageStats(&stats, src8, n, bpp) || stats.min != lo || stats.max != hi ||
+        fabs(stats.mean - mean) > 1e-9 * hi || fabs(stats.stddev - stddev) > 1e-6 * hi)
+        return false;
+
+    // median: at least half at or below it, fewer than half below the bin before
+    double med = imagePercentile(&stats, 0.5);
+    long below = 0, atOrBelow = 0;
+    double width = 1 << stats.shift;
+    for (long i=0; i < n; i++)
+    {
+        if (src[i] < med - width) below++;
+        if (src[i] <= med + width) atOrBelow++;
+    }
+
+    return 2*atOrBelow >= n && 2*below < n;
+}
+
+int main()
+{
+    int w = 1920, h = 1080;
+    int bins[][2] = { {2,2}, {3,3}, {4,4}, {2,1}, {1,3}, {5,3} };
+    int bpps[] = { 8, 16, 32 };
+
+    uint8_t *src = (uint8_t *) malloc((long) w * h * 4);
+    uint8_t *dst = (uint8_t *) malloc((long) w * h * 4);
+
+    for (long i=0; i < (long) w * h * 4; i++)
+        src[i] = (rand() & 1) ? 0xff : rand();
+
+    for (int b=0; b < (int) (sizeof(bpps)/sizeof(bpps[0])); b++)
+        for (int k=0; k < (int) (sizeof(bins)/sizeof(bins[0])); k++)
+        {
+            int bpp = bpps[b], binx = bins[k][0], biny = bins[k][1];
+            int reps = 0;
+            double t0 = now(), t;
+
+            // odd sizes too, to cover partial blocks and the scalar tails
+            for (int sz=0; sz < 3; sz++)
+            {
+                int tw = w - sz*7, th = h - sz*5;
+                binPixels(dst, src, tw, th, binx, biny, bpp);
+                bool ok = (bpp == 8)  ? check<uint8_t>(dst, src, tw, th, binx, biny, UINT8_MAX) :
+                          (bpp == 16) ? check<uint16_t>(dst, src, tw, th, binx, biny, UINT16_MAX) :
+                                        check<uint32_t>(dst, src, tw, th, binx, biny, UINT32_MAX);
+                if (!ok)
+                {
+                    printf("%d bpp %dx%d binning of %dx%d is wrong\n", bpp, binx, biny, tw, th);
+                    return 1;
+                }
+            }
+
+            t0 = now();
+            do
+            {
+                binPixels(dst, src, w, h, binx, biny, bpp);
+                reps++;
+            } while ((t = now() - t0) < 0.5);
+
+            printf("%2d bpp %dx%d: %7.3f ms per %dx%d frame\n", bpp, binx, biny, t/reps*1e3, w, h);
+        }
+
+    for (int b=0; b < (int) (sizeof(bpps)/sizeof(bpps[0])); b++)
+    {
+        int bpp = bpps[b];
+        long sizes[] = { 0, 1, 1001, (long) w * h - 3, (long) w * h };
+
+        for (int k=1; k < (int) (sizeof(sizes)/sizeof(sizes[0])); k++)
+        {
+            bool ok = (bpp == 8)  ? checkStats<uint8_t>(src, sizes[k], bpp) :
+                      (bpp == 16) ? checkStats<uint16_t>(src, sizes[k], bpp) :
+                                    checkStats<uint32_t>(src, sizes[k], bpp);
+            if (!ok)
+            {
+                printf("%d bpp statistics of %ld pixels are wrong\n", bpp, sizes[k]);
+                return 1;
+            }
+        }
+
+        ImageStats stats;
+        double min, max, t, t0;
+        int reps = 0;
+
+        t0 = now();
+        do
+        {
+            imageMinMax(src, (long) w * h, bpp, &min, &max);
+            reps++;
+        } while ((t = now() - t0) < 0.5);
+        printf("%2d bpp min/max: %7.3f ms per %dx%d frame\n", bpp, t/reps*1e3, w, h);
+
+        reps = 0;
+        t0 = now();
+        do
+        {
+            imageStats(&stats, src, (long) w * h, bpp);
+            reps++;
+        } while ((t = now() - t0) < 0.5);
+        printf("%2d bpp statistics: %7.3f ms per %dx%d frame\n", bpp, t/reps*1e3, w, h);
+    }
+
+    // a noisy 16 bit sky, which compresses about as well as real frames
+    uint16_t *sky = (uint16_t *) src;
+    for (long i=0; i < (long) w * h; i++)
+        sky[i] = 1000 + (rand() % 64) + ((i % 9973) == 0 ? 30000 : 0);
+
+    size_t sizes[] = { 0, 1, 1000, 300000, (size_t) w * h * 2 };
+    for (int k=0; k < (int) (sizeof(sizes)/sizeof(sizes[0])); k++)
+        for (int level=1; level <= 9; level += 4)
+        {
+            uint8_t *z;
+            size_t zlen;
+            uLongf ulen = sizes[k];
+
+            if (!deflateFrame(&z, &zlen, src, sizes[k], level) ||
+                uncompress(dst, &ulen, z, zlen) != Z_OK || ulen != sizes[k] || memcmp(dst, src, ulen))
+            {
+                printf("deflate of %lu bytes at level %d is wrong\n", (unsigned long) sizes[k], level);
+                return 1;
+            }
+            free(z);
+        }
+
+    for (int level=1; level <= 9; level += 4)
+    {
+        size_t len = (size_t) w * h * 2, zlen;
+        uLongf clen = compressBound(len);
+        uint8_t *z;
+        double t0 = now();
+
+        compress2(dst, &clen, src, len, level);
+        double t1 = now();
+        deflateFrame(&z, &zlen, src, len, level);
+        double t2 = now();
+        free(z);
+
+        printf("level %d compress2: %7.1f ms %lu bytes, deflateFrame: %7.1f ms %lu bytes\n", level,
+               (t1 - t0)*1e3, (unsigned long) clen, (t2 - t1)*1e3, (unsigned long) zlen);
+    }
+
+    return 0;
+}
+#endif
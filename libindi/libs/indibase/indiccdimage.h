@@ -0,0 +1,99 @@
+/*******************************************************************************
+ Copyright(c) 2010, 2011 Gerry Rozema, Jasem Mutlaq. All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#ifndef INDI_CCD_IMAGE_H
+#define INDI_CCD_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Pixel and compression kernels used by CCDChip on whole frames. Large frames are split
+ * into bands of rows worked on by a pool of threads alongside the caller.
+ */
+
+/**
+ * @brief binPixels Sum binx by biny blocks of pixels into one, saturating at the largest pixel value.
+ * Pixels of a last partial block of columns or rows are left out.
+ * @param dst binned frame of w/binx by h/biny pixels, may not overlap src.
+ * @param src frame of w by h pixels.
+ * @param w width of src in pixels.
+ * @param h height of src in pixels.
+ * @param binx horizontal binning.
+ * @param biny vertical binning.
+ * @param bpp bits per pixel, 8, 16 or 32.
+ * @return false if bpp is not supported or memory ran out, leaving dst partly written, true otherwise.
+ */
+bool binPixels(uint8_t *dst, const uint8_t *src, int w, int h, int binx, int biny, int bpp);
+
+/**
+ * @brief imageMinMax Find the smallest and largest of npixels pixels.
+ * @param pixels frame of npixels pixels.
+ * @param npixels number of pixels, may be 0.
+ * @param bpp bits per pixel, 8, 16 or 32.
+ * @param min set to the smallest pixel value, or 0 if there are no pixels.
+ * @param max set to the largest pixel value, or 0 if there are no pixels.
+ * @return false if bpp is not supported, true otherwise.
+ */
+bool imageMinMax(const uint8_t *pixels, long npixels, int bpp, double *min, double *max);
+
+/**
+ * @brief The ImageStats struct holds the statistics of a frame as found by imageStats().
+ * 8 and 16 bit frames get one histogram bin per value, so every statistic is exact. 32 bit
+ * frames get 65536 bins of 65536 values each, exact min, max, mean and stddev and percentiles
+ * to within one bin.
+ */
+struct ImageStats
+{
+    double min, max, mean, stddev;
+    long count;                         // pixels in the frame
+    int shift;                          // bin of a pixel is its value >> shift
+    std::vector<uint32_t> histogram;
+};
+
+/**
+ * @brief imageStats Find min, max, mean, standard deviation and histogram of npixels pixels in one pass.
+ * @param stats filled with the statistics.
+ * @param pixels frame of npixels pixels.
+ * @param npixels number of pixels, may be 0.
+ * @param bpp bits per pixel, 8, 16 or 32.
+ * @return false if bpp is not supported or memory ran out, true otherwise.
+ */
+bool imageStats(ImageStats *stats, const uint8_t *pixels, long npixels, int bpp);
+
+/**
+ * @brief imagePercentile Pixel value below or at which a fraction p of the pixels lie, from the histogram.
+ * @param stats statistics filled by imageStats().
+ * @param p fraction from 0 to 1, 0.5 for the median.
+ * @return the percentile, or 0 if there are no pixels.
+ */
+double imagePercentile(const ImageStats *stats, double p);
+
+/**
+ * @brief deflateFrame Compress a buffer into a zlib stream, the same as compress2() would give
+ * to any zlib reader, but with slices of it deflated in parallel.
+ * @param out set to the compressed data, to be freed by the caller.
+ * @param outlen set to the length of the compressed data.
+ * @param in data to compress.
+ * @param len length of data to compress.
+ * @param level zlib compression level, 1 (fastest) to 9 (smallest).
+ * @return false if memory ran out or zlib failed, true otherwise.
+ */
+bool deflateFrame(uint8_t **out, size_t *outlen, const uint8_t *in, size_t len, int level);
+
+#endif
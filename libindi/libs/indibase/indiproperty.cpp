@@ -17,6 +17,7 @@
 *******************************************************************************/
 
 #include <pthread.h>
+#include <string.h>
 
 #include "basedevice.h"
 #include "baseclient.h"
@@ -30,6 +31,7 @@ INDI::Property::Property()
     pRegistered = false;
     pDynamic = false;
     pType = INDI_UNKNOWN;
+    eCount = 0;
 }
 
 INDI::Property::~Property()
@@ -326,3 +328,117 @@ IBLOBVectorProperty   *INDI::Property::getBLOB()
 
 }
 
+
+/* vectors with more elements than this are searched by hash in findElement() */
+#define MAXLINEARFIND 8
+
+/* return the number of elements in the vector property p of type t and point
+ * *names at the name of the first, the others following every stride bytes.
+ */
+static int elementNames(void *p, INDI_PROPERTY_TYPE t, const char **names, size_t *stride)
+{
+    int n = 0;
+
+    if (p == NULL)
+        return 0;
+
+    switch (t)
+    {
+    case INDI_NUMBER:
+     n       = ((INumberVectorProperty *) p)->nnp;
+     *names  = n > 0 ? ((INumberVectorProperty *) p)->np[0].name : NULL;
+     *stride = sizeof(INumber);
+     break;
+
+    case INDI_TEXT:
+     n       = ((ITextVectorProperty *) p)->ntp;
+     *names  = n > 0 ? ((ITextVectorProperty *) p)->tp[0].name : NULL;
+     *stride = sizeof(IText);
+     break;
+
+    case INDI_SWITCH:
+     n       = ((ISwitchVectorProperty *) p)->nsp;
+     *names  = n > 0 ? ((ISwitchVectorProperty *) p)->sp[0].name : NULL;
+     *stride = sizeof(ISwitch);
+     break;
+
+    case INDI_LIGHT:
+     n       = ((ILightVectorProperty *) p)->nlp;
+     *names  = n > 0 ? ((ILightVectorProperty *) p)->lp[0].name : NULL;
+     *stride = sizeof(ILight);
+     break;
+
+    case INDI_BLOB:
+     n       = ((IBLOBVectorProperty *) p)->nbp;
+     *names  = n > 0 ? ((IBLOBVectorProperty *) p)->bp[0].name : NULL;
+     *stride = sizeof(IBLOB);
+     break;
+
+    default:
+     break;
+    }
+
+    return n;
+}
+
+/* FNV-1a */
+static size_t hashElementName(const char *name)
+{
+    size_t h = 2166136261u;
+
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+
+    return h;
+}
+
+int INDI::Property::findElement(const char *name)
+{
+    const char *names = NULL;
+    size_t stride = 0, mask, h;
+    int n = elementNames(pPtr, pType, &names, &stride);
+    int i;
+
+    if (name == NULL)
+        return -1;
+
+    if (n > MAXLINEARFIND)
+    {
+        // Build the hash on first use, and again whenever the vector changes size
+        if (n != eCount)
+        {
+            size_t size = 16;
+            while (size < 2 * (size_t) n)
+                size *= 2;
+
+            eIndex.assign(size, -1);
+            for (i = 0; i < n; i++)
+            {
+                for (h = hashElementName(names + i*stride) & (size-1); eIndex[h] >= 0; h = (h+1) & (size-1))
+                    ;
+                eIndex[h] = i;
+            }
+            eCount = n;
+        }
+
+        mask = eIndex.size() - 1;
+        for (h = hashElementName(name) & mask; eIndex[h] >= 0; h = (h+1) & mask)
+        {
+            if (!strcmp(names + eIndex[h]*stride, name))
+                return eIndex[h];
+        }
+    }
+
+    // Small vector, or elements renamed since the hash was built
+    for (i = 0; i < n; i++)
+    {
+        if (!strcmp(names + i*stride, name))
+        {
+            if (n > MAXLINEARFIND)
+                eCount = 0;
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -19,6 +19,8 @@
 #ifndef INDI_INDIPROPERTY_H
 #define INDI_INDIPROPERTY_H
 
+#include <vector>
+
 #include "indibase.h"
 
 
@@ -60,12 +62,19 @@ public:
     ILightVectorProperty  *getLight();
     IBLOBVectorProperty   *getBLOB();
 
+    /** \return index of the first element called name in the vector, or -1 if there is none.
+        Vectors of more than a few elements are searched with a hash of their element names. */
+    int findElement(const char *name);
+
 private:
     void *pPtr;
     BaseDevice *dp;
     INDI_PROPERTY_TYPE pType;
     bool pRegistered;
     bool pDynamic;
+
+    std::vector<int> eIndex;    // element positions hashed by name, -1 if free
+    int eCount;                 // number of elements eIndex was built for
 };
 
 } // namespace INDI
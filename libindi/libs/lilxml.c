@@ -33,14 +33,47 @@
 
 #include "lilxml.h"
 
+typedef struct _Arena Arena;
+
 /* used to efficiently manage growing malloced string space */
 typedef struct {
     char *s;				/* malloced memory for string */
     int sl;				/* string length, sans trailing \0 */
     int sm;				/* total malloced bytes */
+    Arena *ar;				/* arena s is in, NULL if malloced */
 } String;
 #define	MINMEM	64			/* starting string length */
 
+/* a parser may build each tree in an arena instead of mallocing every
+ * element, attribute and string. all of a tree is then released at once when
+ * its root is deleted, and the arena goes back to its parser to be reused,
+ * so parsing a message usually needs no malloc at all.
+ * strings that grow past MAXARSTR, such as BLOB pcdata, move to the heap so
+ * the arena stays small.
+ */
+typedef struct _ArenaBlk {
+    struct _ArenaBlk *next;		/* older block */
+    size_t size;			/* bytes of memory after header */
+    size_t used;			/* bytes of memory handed out */
+} ArenaBlk;
+#define	ARBLKHDR  ((sizeof(ArenaBlk)+15) & ~(size_t)15)	/* aligned header */
+#define	ARBLKMEM(b) ((char *)(b) + ARBLKHDR)		/* block memory */
+#define	MINARBLK  8192			/* first arena block size */
+#define	MAXARSTR  4096			/* larger Strings are malloced */
+
+/* arenas of one parser, shared with the trees still using them */
+typedef struct {
+    int ntrees;				/* arenas held by undeleted trees */
+    int parser;				/* 1 while the parser exists */
+    Arena *spare;			/* reset arena ready for next tree */
+} ArenaPool;
+
+struct _Arena {
+    ArenaBlk *blk;			/* newest and largest block first */
+    ArenaPool *pool;			/* where to return to when done */
+    XMLEle *root;			/* tree this arena holds */
+};
+
 static int oneXMLchar (LilXML *lp, int c, char ynot[]);
 static void initParser(LilXML *lp);
 static void pushXMLEle(LilXML *lp);
@@ -52,9 +85,22 @@ static void freeAtt (XMLAtt *a);
 static int isTokenChar (int start, int c);
 static void growString (String *sp, int c);
 static void appendString (String *sp, const char *str);
+static void appendChars (String *sp, const char *s, int n);
+static int takeXMLRun (LilXML *lp, const char *s, const char *end);
+static int countLines (const char *s, const char *end);
+static void startCon (LilXML *lp);
+static void addPCData (LilXML *lp, const char *s, int n);
 static void freeString (String *sp);
 static void newString (String *sp);
+static void sizeString (String *sp, int n);
 static void *moremem (void *old, int n);
+static Arena *newArena (ArenaPool *pool);
+static void doneArena (Arena *ar);
+static void freeArena (Arena *ar);
+static void *arenaMem (Arena *ar, void *old, int oldn, int n);
+static void *growMem (Arena *ar, void *old, int oldn, int n);
+static void freeEle (XMLEle *ep);
+static XMLEle *rootXMLEle (XMLEle *ep);
 
 typedef enum  {
     LOOK4START = 0,			/* looking for first element start */
@@ -84,6 +130,9 @@ struct _LilXML {
     int delim;				/* attribute value delimiter */
     int lastc;				/* last char (just used wiht skipping)*/
     int skipping;			/* in comment or declaration */
+    ArenaPool *pool;			/* arenas for new trees, if used */
+    XMLPCDataCB *pcdatacb;		/* takes pcdata of chosen elements */
+    void *pcdataarg;			/* passed to pcdatacb */
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -98,6 +147,8 @@ struct _xml_ele {
     int eit;				/* used to iterate over el[] */
     String pcdata;			/* character data in this element */
     int pcdata_hasent;			/* 1 if pcdata contains an entity char*/
+    int pcdata_taken;			/* 1 if pcdata goes to pcdatacb */
+    Arena *ar;				/* arena holding this element, if any */
 };
 
 /* internal representation of an attribute */
@@ -143,53 +194,122 @@ newLilXML ()
 void
 delLilXML (LilXML *lp)
 {
-        delXMLEle (lp->ce);
+        delXMLEle (rootXMLEle (lp->ce));
         freeString (&lp->endtag);
+        arenaLilXML (lp, 0);
         (*myfree) (lp);
 }
 
+/* build each tree lp returns in an arena if on, else malloc each part.
+ * trees from an arena are still deleted with delXMLEle(), which should be
+ * done by the thread using lp.
+ */
+void
+arenaLilXML (LilXML *lp, int on)
+{
+        ArenaPool *pool = lp->pool;
+
+        if (on && !pool) {
+            pool = (ArenaPool *) moremem (NULL, sizeof(ArenaPool));
+            memset (pool, 0, sizeof(*pool));
+            pool->parser = 1;
+            lp->pool = pool;
+        } else if (!on && pool) {
+            /* trees still out free the pool when their arenas come back */
+            lp->pool = NULL;
+            pool->parser = 0;
+            if (pool->spare)
+                freeArena (pool->spare);
+            pool->spare = NULL;
+            if (pool->ntrees == 0)
+                (*myfree) (pool);
+        }
+}
+
+/* pass the pcdata of each element for which cb returns 1 to cb as it is
+ * parsed instead of collecting it, or stop if cb is NULL.
+ */
+void
+pcdataLilXML (LilXML *lp, XMLPCDataCB *cb, void *arg)
+{
+        lp->pcdatacb = cb;
+        lp->pcdataarg = arg;
+}
+
 /* delete ep and all its children and remove from parent's list if known */
 void
 delXMLEle (XMLEle *ep)
 {
+        Arena *ar;
         int i;
 
         /* benign if NULL */
         if (!ep)
             return;
 
+        /* remove from parent's list if known */
+        if (ep->pe) {
+            XMLEle *pe = ep->pe;
+            for (i = 0; i < pe->nel; i++) {
+                if (pe->el[i] == ep) {
+                    memmove (&pe->el[i], &pe->el[i+1],
+                                              (--pe->nel-i)*sizeof(XMLEle*));
+                    break;
+                }
+            }
+        }
+
+        /* delete all parts of ep, at once if it is the root of an arena */
+        ar = ep->ar;
+        freeEle (ep);
+        if (ar && ar->root == ep)
+            doneArena (ar);
+}
+
+/* free ep and all its children, except what is in ep's arena */
+static void
+freeEle (XMLEle *ep)
+{
+        int i;
+
         /* delete all parts of ep */
         freeString (&ep->tag);
         freeString (&ep->pcdata);
         if (ep->at) {
             for (i = 0; i < ep->nat; i++)
                 freeAtt (ep->at[i]);
-            (*myfree) (ep->at);
+            if (!ep->ar)
+                (*myfree) (ep->at);
         }
         if (ep->el) {
             for (i = 0; i < ep->nel; i++) {
-                /* forget parent so deleting doesn't modify _this_ el[] */
-                ep->el[i]->pe = NULL;
+                XMLEle *cp = ep->el[i];
 
-                delXMLEle (ep->el[i]);
-            }
-            (*myfree) (ep->el);
-        }
+                /* forget parent so deleting doesn't modify _this_ el[] */
+                cp->pe = NULL;
 
-        /* remove from parent's list if known */
-        if (ep->pe) {
-            XMLEle *pe = ep->pe;
-            for (i = 0; i < pe->nel; i++) {
-                if (pe->el[i] == ep) {
-                    memmove (&pe->el[i], &pe->el[i+1],
-                                              (--pe->nel-i)*sizeof(XMLEle*));
-                    break;
-                }
+                /* children from elsewhere, eg appXMLEle(), go their way */
+                if (cp->ar && cp->ar == ep->ar)
+                    freeEle (cp);
+                else
+                    delXMLEle (cp);
             }
+            if (!ep->ar)
+                (*myfree) (ep->el);
         }
 
         /* delete ep itself */
-        (*myfree) (ep);
+        if (!ep->ar)
+            (*myfree) (ep);
+}
+
+/* return the root of the tree holding ep, or NULL if ep is NULL */
+static XMLEle *
+rootXMLEle (XMLEle *ep)
+{
+        while (ep && ep->pe)
+            ep = ep->pe;
+        return (ep);
 }
 
 /* process one more character of an XML file.
@@ -264,6 +384,35 @@ readXMLEle (LilXML *lp, int newc, char ynot[])
         return (root);
 }
 
+/* process up to size chars of an XML file at buf, just as readXMLEle() would
+ * one at a time, but taking each run of tag, attribute or pcdata chars whole.
+ * *used is set to the number of chars taken from buf.
+ * when find closure with outter element return root of complete tree.
+ * when find error return NULL with reason in ynot[].
+ * when buf is used up return NULL with ynot[0] = '\0'.
+ * after a tree or an error, call again with what is left of buf.
+ * N.B. it is up to the caller to delete any tree returned with delXMLEle().
+ */
+XMLEle *
+readXMLChunk (LilXML *lp, const char *buf, int size, int *used, char ynot[])
+{
+        const char *s = buf, *end = buf + size;
+        XMLEle *root = NULL;
+
+        ynot[0] = '\0';
+
+        while (s < end && !root && !ynot[0]) {
+            int n = takeXMLRun (lp, s, end);
+            if (n > 0)
+                s += n;
+            else
+                root = readXMLEle (lp, (unsigned char)*s++, ynot);
+        }
+
+        *used = s - buf;
+        return (root);
+}
+
 /* parse the given XML string.
  * return XMLEle* else NULL with reason why in ynot[]
  */
@@ -476,7 +625,8 @@ addXMLEle (XMLEle *parent, const char *tag)
 void
 appXMLEle (XMLEle *ep, XMLEle *newep)
 {
-        ep->el = (XMLEle **) moremem (ep->el, (ep->nel+1)*sizeof(XMLEle *));
+        ep->el = (XMLEle **) growMem (ep->ar, ep->el, ep->nel*sizeof(XMLEle *),
+                                                (ep->nel+1)*sizeof(XMLEle *));
         ep->el[ep->nel++] = newep;
 }
 
@@ -758,7 +908,7 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
             if (isTokenChar (0, c))
                 growString (&lp->ce->tag, c);
             else if (c == '>')
-                lp->cs = LOOK4CON;
+                startCon (lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else
@@ -767,7 +917,7 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
 
         case LOOK4ATTRN:		/* looking for attr name, > or / */
             if (c == '>')
-                lp->cs = LOOK4CON;
+                startCon (lp);
             else if (c == '/')
                 lp->cs = SAWSLASH;
             else if (isTokenChar (1, c)) {
@@ -844,7 +994,8 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
             if (c == '<')
                 lp->cs = SAWLTINCON;
             else if (!isspace(c)) {
-                growString (&lp->ce->pcdata, c);
+                char ch = (char)c;
+                addPCData (lp, &ch, 1);
                 lp->cs = INCON;
             }
             break;
@@ -857,11 +1008,12 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
             } else if (c == '<') {
                 /* chomp trailing whitespace */
                 while (lp->ce->pcdata.sl > 0 &&
-                            isspace(lp->ce->pcdata.s[lp->ce->pcdata.sl-1]))
+                            isspace((unsigned char)lp->ce->pcdata.s[lp->ce->pcdata.sl-1]))
                     lp->ce->pcdata.s[--(lp->ce->pcdata.sl)] = '\0';
                 lp->cs = SAWLTINCON;
             } else {
-                growString (&lp->ce->pcdata, c);
+                char ch = (char)c;
+                addPCData (lp, &ch, 1);
             }
             break;
 
@@ -869,10 +1021,11 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
             if (c == ';') {
                 /* if find a recognized esc seq, add equiv char else raw seq */
                 growString (&lp->entity, c);
-                if (decodeEntity (lp->entity.s, &c))
-                    growString (&lp->ce->pcdata, c);
-                else {
-                    appendString(&lp->ce->pcdata, lp->entity.s);
+                if (decodeEntity (lp->entity.s, &c)) {
+                    char ch = (char)c;
+                    addPCData (lp, &ch, 1);
+                } else {
+                    addPCData (lp, lp->entity.s, lp->entity.sl);
                     lp->ce->pcdata_hasent = 1;
                 }
                 freeString (&lp->entity);
@@ -928,14 +1081,144 @@ oneXMLchar (LilXML *lp, int c, char ynot[])
         return (0);
 }
 
-/* set up for a fresh start again */
+/* take the run of chars at s, before end, that readXMLEle() would just add
+ * to one string or skip in the present state of lp, and do so all at once.
+ * markup, entities and a pending '<' are left to readXMLEle().
+ * return number of chars taken, 0 if s does not start such a run.
+ */
+static int
+takeXMLRun (LilXML *lp, const char *s, const char *end)
+{
+        const char *p = s;
+        const char *q;
+        String *sp = NULL;
+
+        if (lp->lastc == '<')
+            return (0);
+
+        if (lp->skipping) {
+            /* comment or declaration, up to '>' */
+            q = memchr (s, '>', end-s);
+            p = q ? q : end;
+            if ((q = memchr (s, '\0', p-s)) != NULL)
+                p = q;
+        } else switch (lp->cs) {
+        case LOOK4START:		/* ignored up to first '<' */
+            q = memchr (s, '<', end-s);
+            p = q ? q : end;
+            if ((q = memchr (s, '\0', p-s)) != NULL)
+                p = q;
+            break;
+
+        case LOOK4TAG:			/* whitespace skipped while looking */
+        case LOOK4ATTRN:
+        case LOOK4CON:
+        case LOOK4CLOSETAG:
+            while (p < end && isspace((unsigned char)*p))
+                p++;
+            break;
+
+        case INTAG:			/* tag, attr name or end tag chars */
+        case INATTRN:
+        case INCLOSETAG:
+            if (lp->cs == INTAG)
+                sp = &lp->ce->tag;
+            else if (lp->cs == INATTRN)
+                sp = &lp->ce->at[lp->ce->nat-1]->name;
+            else
+                sp = &lp->endtag;
+            while (p < end && isTokenChar (0, (unsigned char)*p))
+                p++;
+            appendChars (sp, s, p-s);
+            break;
+
+        case INATTRV:			/* attr value, control chars dropped */
+            sp = &lp->ce->at[lp->ce->nat-1]->valu;
+            for (q = p; p < end && *p && *p != lp->delim && *p != '&'
+                                                        && *p != '<'; p++) {
+                if (iscntrl((unsigned char)*p)) {
+                    appendChars (sp, q, p-q);
+                    q = p+1;
+                }
+            }
+            appendChars (sp, q, p-q);
+            break;
+
+        case INCON:			/* pcdata, up to markup or entity */
+            q = memchr (s, '<', end-s);
+            p = q ? q : end;
+            if ((q = memchr (s, '&', p-s)) != NULL)
+                p = q;
+            if ((q = memchr (s, '\0', p-s)) != NULL)
+                p = q;
+            addPCData (lp, s, p-s);
+            break;
+
+        default:
+            break;
+        }
+
+        if (p > s) {
+            lp->ln += countLines (s, p);
+            lp->lastc = p[-1];
+        }
+        return (p-s);
+}
+
+/* return number of newlines from s up to end */
+static int
+countLines (const char *s, const char *end)
+{
+        int n = 0;
+
+        while ((s = memchr (s, '\n', end-s)) != NULL) {
+            s++;
+            n++;
+        }
+        return (n);
+}
+
+/* the start tag of ce is complete, look for its content.
+ * ask pcdatacb, if any, whether it takes the pcdata of ce.
+ */
+static void
+startCon (LilXML *lp)
+{
+        lp->cs = LOOK4CON;
+        if (lp->pcdatacb)
+            lp->ce->pcdata_taken =
+                        (*lp->pcdatacb) (lp->ce, NULL, 0, lp->pcdataarg) > 0;
+}
+
+/* add the n chars at s to the pcdata of ce, or pass them to pcdatacb */
+static void
+addPCData (LilXML *lp, const char *s, int n)
+{
+        if (lp->ce->pcdata_taken)
+            (void) (*lp->pcdatacb) (lp->ce, s, n, lp->pcdataarg);
+        else
+            appendChars (&lp->ce->pcdata, s, n);
+}
+
+/* set up for a fresh start again, keeping endtag memory, arenas and
+ * pcdata handler
+ */
 static void
 initParser(LilXML *lp)
 {
-        delXMLEle (lp->ce);
-        freeString (&lp->endtag);
+        String endtag = lp->endtag;
+        ArenaPool *pool = lp->pool;
+        XMLPCDataCB *pcdatacb = lp->pcdatacb;
+        void *pcdataarg = lp->pcdataarg;
+
+        delXMLEle (rootXMLEle (lp->ce));
+        freeString (&lp->entity);
         memset (lp, 0, sizeof(*lp));
-        newString (&lp->endtag);
+        lp->endtag = endtag;
+        lp->pool = pool;
+        lp->pcdatacb = pcdatacb;
+        lp->pcdataarg = pcdataarg;
+        resetEndTag (lp);
         lp->cs = LOOK4START;
         lp->ln = 1;
 }
@@ -948,7 +1231,23 @@ initParser(LilXML *lp)
 static void
 pushXMLEle(LilXML *lp)
 {
-        lp->ce = growEle (lp->ce);
+        if (!lp->ce && lp->pool) {
+            /* new root, in the spare arena or a new one */
+            ArenaPool *pool = lp->pool;
+            Arena *ar = pool->spare ? pool->spare : newArena (pool);
+            XMLEle *root = (XMLEle *) arenaMem (ar, NULL, 0, sizeof(XMLEle));
+
+            pool->spare = NULL;
+            pool->ntrees++;
+            memset (root, 0, sizeof(XMLEle));
+            root->ar = ar;
+            root->tag.ar = root->pcdata.ar = ar;
+            newString (&root->tag);
+            newString (&root->pcdata);
+            ar->root = root;
+            lp->ce = root;
+        } else
+            lp->ce = growEle (lp->ce);
         resetEndTag(lp);
 }
 
@@ -966,15 +1265,18 @@ popXMLEle(LilXML *lp)
 static XMLEle *
 growEle (XMLEle *pe)
 {
-        XMLEle *newe = (XMLEle *) moremem (NULL, sizeof(XMLEle));
+        Arena *ar = pe ? pe->ar : NULL;
+        XMLEle *newe = (XMLEle *) growMem (ar, NULL, 0, sizeof(XMLEle));
 
         memset (newe, 0, sizeof(XMLEle));
+        newe->ar = newe->tag.ar = newe->pcdata.ar = ar;
         newString (&newe->tag);
         newString (&newe->pcdata);
         newe->pe = pe;
 
         if (pe) {
-            pe->el = (XMLEle **) moremem (pe->el, (pe->nel+1)*sizeof(XMLEle *));
+            pe->el = (XMLEle **) growMem (ar, pe->el, pe->nel*sizeof(XMLEle *),
+                                                (pe->nel+1)*sizeof(XMLEle *));
             pe->el[pe->nel++] = newe;
         }
 
@@ -985,20 +1287,22 @@ growEle (XMLEle *pe)
 static XMLAtt *
 growAtt(XMLEle *ep)
 {
-        XMLAtt *newa = (XMLAtt *) moremem (NULL, sizeof(XMLAtt));
+        XMLAtt *newa = (XMLAtt *) growMem (ep->ar, NULL, 0, sizeof(XMLAtt));
 
         memset (newa, 0, sizeof(*newa));
+        newa->name.ar = newa->valu.ar = ep->ar;
         newString(&newa->name);
         newString(&newa->valu);
         newa->ce = ep;
 
-        ep->at = (XMLAtt **) moremem (ep->at, (ep->nat+1)*sizeof(XMLAtt *));
+        ep->at = (XMLAtt **) growMem (ep->ar, ep->at, ep->nat*sizeof(XMLAtt *),
+                                                (ep->nat+1)*sizeof(XMLAtt *));
         ep->at[ep->nat++] = newa;
 
         return (newa);
 }
 
-/* free a and all it holds */
+/* free a and all it holds, unless in an arena */
 static void
 freeAtt (XMLAtt *a)
 {
@@ -1006,15 +1310,18 @@ freeAtt (XMLAtt *a)
             return;
         freeString (&a->name);
         freeString (&a->valu);
-        (*myfree)(a);
+        if (!a->ce || !a->ce->ar)
+            (*myfree)(a);
 }
 
-/* reset endtag */
+/* reset endtag, keeping its memory */
 static void
 resetEndTag(LilXML *lp)
 {
-        freeString (&lp->endtag);
-        newString (&lp->endtag);
+        if (!lp->endtag.s)
+            newString (&lp->endtag);
+        lp->endtag.s[0] = '\0';
+        lp->endtag.sl = 0;
 }
 
 /* 1 if c is a valid token character, else 0.
@@ -1036,7 +1343,7 @@ growString (String *sp, int c)
             if (!sp->s)
                 newString (sp);
             else
-                sp->s = (char *) moremem (sp->s, sp->sm *= 2);
+                sizeString (sp, 2*sp->sm);
         }
         sp->s[--l] = '\0';
         sp->s[--l] = (char)c;
@@ -1047,34 +1354,60 @@ growString (String *sp, int c)
 static void
 appendString (String *sp, const char *str)
 {
-        int strl = strlen (str);
-        int l = sp->sl + strl + 1;	/* need room for '\0' */
+        appendChars (sp, str, strlen (str));
+}
+
+/* append the n chars at s to the String storage at *sp.
+ * storage at least doubles when it grows, so long pcdata taken a run at a
+ * time is not copied over and over.
+ */
+static void
+appendChars (String *sp, const char *s, int n)
+{
+        int l = sp->sl + n + 1;		/* need room for '\0' */
 
         if (l > sp->sm) {
             if (!sp->s)
                 newString (sp);
             if (l > sp->sm)
-                sp->s = (char *) moremem (sp->s, (sp->sm = l));
+                sizeString (sp, l > 2*sp->sm ? l : 2*sp->sm);
         }
-        strcpy (&sp->s[sp->sl], str);
-        sp->sl += strl;
+        memcpy (&sp->s[sp->sl], s, n);
+        sp->sl += n;
+        sp->s[sp->sl] = '\0';
 }
 
-/* init a String with a malloced string containing just \0 */
+/* init a String with a string containing just \0, in its arena if any */
 static void
 newString(String *sp)
 {
-        sp->s = (char *)moremem(NULL, MINMEM);
+        sp->s = (char *)growMem(sp->ar, NULL, 0, MINMEM);
         sp->sm = MINMEM;
         *sp->s = '\0';
         sp->sl = 0;
 }
 
-/* free memory used by the given String */
+/* make room for n bytes in the given String, moving it out of its arena if
+ * it gets large.
+ */
+static void
+sizeString (String *sp, int n)
+{
+        if (sp->ar && n > MAXARSTR) {
+            char *s = (char *) moremem (NULL, n);
+            memcpy (s, sp->s, sp->sl+1);
+            sp->s = s;
+            sp->ar = NULL;
+        } else
+            sp->s = (char *) growMem (sp->ar, sp->s, sp->sm, n);
+        sp->sm = n;
+}
+
+/* free memory used by the given String. arena memory waits for its tree. */
 static void
 freeString (String *sp)
 {
-        if (sp->s)
+        if (sp->s && !sp->ar)
             (*myfree) (sp->s);
         sp->s = NULL;
         sp->sl = 0;
@@ -1088,6 +1421,206 @@ moremem (void *old, int n)
         return (old ? (*myrealloc)(old, n) : (*mymalloc)(n));
 }
 
+/* like moremem() but from ar if not NULL. old is oldn bytes. */
+static void *
+growMem (Arena *ar, void *old, int oldn, int n)
+{
+        return (ar ? arenaMem (ar, old, oldn, n) : moremem (old, n));
+}
+
+/* return a new arena for pool, with one block */
+static Arena *
+newArena (ArenaPool *pool)
+{
+        Arena *ar = (Arena *) moremem (NULL, sizeof(Arena));
+
+        ar->blk = (ArenaBlk *) moremem (NULL, ARBLKHDR + MINARBLK);
+        ar->blk->next = NULL;
+        ar->blk->size = MINARBLK;
+        ar->blk->used = 0;
+        ar->pool = pool;
+        ar->root = NULL;
+        return (ar);
+}
+
+/* return n bytes from ar, 16 byte aligned. if old is not NULL it is the last
+ * oldn bytes handed out, its contents are kept and it grows in place if room.
+ */
+static void *
+arenaMem (Arena *ar, void *old, int oldn, int n)
+{
+        ArenaBlk *b = ar->blk;
+        size_t need = ((size_t)n + 15) & ~(size_t)15;
+        void *p;
+
+        /* grow the last piece in place? */
+        if (old && (char *)old + (((size_t)oldn + 15) & ~(size_t)15)
+                                            == ARBLKMEM(b) + b->used
+                        && (char *)old - ARBLKMEM(b) + need <= b->size) {
+            b->used = (char *)old - ARBLKMEM(b) + need;
+            return (old);
+        }
+
+        /* add a larger block if out of room */
+        if (b->used + need > b->size) {
+            size_t size = 2*b->size;
+            while (size < need)
+                size *= 2;
+            b = (ArenaBlk *) moremem (NULL, ARBLKHDR + size);
+            b->next = ar->blk;
+            b->size = size;
+            b->used = 0;
+            ar->blk = b;
+        }
+
+        p = ARBLKMEM(b) + b->used;
+        b->used += need;
+        if (old)
+            memcpy (p, old, oldn < n ? oldn : n);
+        return (p);
+}
+
+/* the tree in ar was deleted. reset ar, keeping only its largest block, and
+ * keep it for the next tree of its parser, else free it.
+ */
+static void
+doneArena (Arena *ar)
+{
+        ArenaPool *pool = ar->pool;
+        ArenaBlk *b;
+
+        while ((b = ar->blk->next) != NULL) {
+            ar->blk->next = b->next;
+            (*myfree) (b);
+        }
+        ar->blk->used = 0;
+        ar->root = NULL;
+
+        pool->ntrees--;
+        if (pool->parser && !pool->spare)
+            pool->spare = ar;
+        else {
+            freeArena (ar);
+            if (!pool->parser && pool->ntrees == 0)
+                (*myfree) (pool);
+        }
+}
+
+/* free all memory of ar */
+static void
+freeArena (Arena *ar)
+{
+        ArenaBlk *b;
+
+        while ((b = ar->blk) != NULL) {
+            ar->blk = b->next;
+            (*myfree) (b);
+        }
+        (*myfree) (ar);
+}
+
+#ifdef LILXML_BENCHMARK
+/* standalone benchmark of readXMLChunk() against readXMLEle() on a file of
+ * recorded INDI traffic, such as a driver's stdout or a capture of what
+ * indiserver sends a client. the file is parsed as if read 4 KB at a time.
+ * built as lilxmlbench with -DINDI_BENCHMARKS=ON.
+ * lilxmlbench traffic.xml [passes]
+ */
+
+#include <time.h>
+
+#define	BENCHREAD	4096		/* bytes per simulated read() */
+
+static double
+benchSecs (void)
+{
+        struct timespec ts;
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (ts.tv_sec + ts.tv_nsec*1e-9);
+}
+
+/* parse buf with lp, by chunk if chunk else by char.
+ * return number of trees, and add their printed length to *prl if not NULL.
+ */
+static int
+benchParse (LilXML *lp, const char *buf, int len, int chunk, long *prl)
+{
+        char ynot[1024];
+        int ntrees = 0;
+        int i, n, used;
+
+        for (i = 0; i < len; i += n) {
+            n = len - i < BENCHREAD ? len - i : BENCHREAD;
+            for (used = 0; used < n; ) {
+                XMLEle *root;
+                int u;
+
+                if (chunk) {
+                    root = readXMLChunk (lp, buf+i+used, n-used, &u, ynot);
+                    used += u;
+                } else
+                    root = readXMLEle (lp, buf[i+used++], ynot);
+                if (root) {
+                    if (prl)
+                        *prl += sprlXMLEle (root, 0);
+                    delXMLEle (root);
+                    ntrees++;
+                } else if (ynot[0])
+                    fprintf (stderr, "Error: %s\n", ynot);
+            }
+        }
+        return (ntrees);
+}
+
+int
+main (int ac, char *av[])
+{
+        int npasses = ac > 2 ? atoi (av[2]) : 20;
+        FILE *fp;
+        char *buf;
+        long len;
+        int chunk;
+
+        if (ac < 2 || !(fp = fopen (av[1], "r"))) {
+            fprintf (stderr, "Usage: %s traffic.xml [passes]\n", av[0]);
+            return (1);
+        }
+        fseek (fp, 0L, SEEK_END);
+        len = ftell (fp);
+        rewind (fp);
+        buf = (char *) malloc (len);
+        if (fread (buf, 1, len, fp) != (size_t)len) {
+            fprintf (stderr, "%s: short read\n", av[1]);
+            return (1);
+        }
+        fclose (fp);
+
+        for (chunk = 0; chunk < 2; chunk++) {
+            LilXML *lp = newLilXML();
+            long prl = 0;
+            int ntrees = 0;
+            double t0, dt;
+            int i;
+
+            /* once to compare results, then timed */
+            arenaLilXML (lp, 1);
+            benchParse (lp, buf, len, chunk, &prl);
+            t0 = benchSecs();
+            for (i = 0; i < npasses; i++)
+                ntrees += benchParse (lp, buf, len, chunk, NULL);
+            dt = benchSecs() - t0;
+            printf ("%-12s %8d trees %12ld printed  %8.1f MB/s %8.2f us/tree\n",
+                        chunk ? "readXMLChunk" : "readXMLEle", ntrees/npasses,
+                        prl, npasses*len/dt/1e6, dt/ntrees*1e6);
+            delLilXML (lp);
+        }
+
+        free (buf);
+        return (0);
+}
+#endif
+
 #if defined(MAIN_TST)
 int
 main (int ac, char *av[])
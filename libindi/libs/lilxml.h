@@ -71,6 +71,9 @@ typedef struct _xml_att XMLAtt;
 typedef struct _xml_ele XMLEle;
 typedef struct _LilXML LilXML;
 
+/** \brief Handler of the pcdata of chosen elements, see pcdataLilXML(). */
+typedef int (XMLPCDataCB)(XMLEle *ep, const char *pcdata, int len, void *arg);
+
 /**
  * \defgroup lilxmlFunctions XML Functions: Functions to parse, process, and search XML.
  */
@@ -88,6 +91,21 @@ extern LilXML *newLilXML(void);
 */
 extern void delLilXML (LilXML *lp);
 
+/** \brief Build the trees returned by a lilxml parser in an arena.
+    With the arena on, each element, attribute and short string of a tree comes from one block of memory instead of its own malloc. Deleting the root with delXMLEle() releases it all at once, and the parser reuses the block for its next tree. Large pcdata such as BLOBs is still malloced. Trees must be deleted by the thread using the parser.
+    \param lp a pointer to a lilxml parser.
+    \param on 1 to use an arena for the trees parsed from now on, 0 to malloc each part.
+*/
+extern void arenaLilXML (LilXML *lp, int on);
+
+/** \brief Let a handler take the pcdata of chosen elements as it is parsed instead of collecting it in the element.
+    Once the start tag of an element has been parsed, cb is called with pcdata NULL and len 0 and returns 1 to take the pcdata of that element, 0 to leave it alone. Each piece of the pcdata of a taken element is then passed to cb as soon as it is parsed, with entities decoded but trailing whitespace kept. pcdataXMLEle() of a taken element is empty. This lets a large BLOB be used while it arrives without ever holding it whole.
+    \param lp a pointer to a lilxml parser.
+    \param cb the handler, or NULL to collect all pcdata again.
+    \param arg passed to cb as is.
+*/
+extern void pcdataLilXML (LilXML *lp, XMLPCDataCB *cb, void *arg);
+
 /** \brief Delete an XML element.
     \return a pointer to the XML Element to be deleted.
 */
@@ -101,6 +119,17 @@ extern void delXMLEle (XMLEle *e);
  */
 extern XMLEle *readXMLEle (LilXML *lp, int c, char errmsg[]);
 
+/** \brief Process a buffer of XML, taking runs of tag, attribute and pcdata characters whole.
+    The result is the same as feeding each character to readXMLEle() but much faster, especially for long pcdata such as BLOBs. It stops after each complete element or error, so call it again with the rest of the buffer until it is all used.
+    \param lp a pointer to a lilxml parser.
+    \param buf the characters to process.
+    \param size the number of characters in buf.
+    \param used set to the number of characters of buf processed.
+    \param errmsg a buffer to store error messages if an error in parsing is encounterd.
+    \return a pointer to the XML element once a complete valid XML element is parsed. NULL if buf is used up with the element still in progress, or if a parsing error occurs. Check errmsg for errors if NULL is returned.
+ */
+extern XMLEle *readXMLChunk (LilXML *lp, const char *buf, int size, int *used, char errmsg[]);
+
 /* search functions */
 /** \brief Find an XML attribute within an XML element.
     \param e a pointer to the XML element to search.